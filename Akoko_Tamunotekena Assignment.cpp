@@ -1,294 +1,5492 @@
-#include <iostream>
-#include <string>
-#include <list>         // Implements Doubly Linked List for dynamic records [3, 4]
-#include <stack>        // Implements LIFO principle for Undo/Redo [5, 6]
-#include <queue>        // Provides Priority Queue for prioritized loading [7, 8]
-#include <vector>       // Used as a dynamic Array for audit/reporting [1, 9]
-#include <limits>       // For input cleaning
-
-// Define the Parcel Structure (Requirement 1)
-struct Parcel {
-    int id;
-    std::string sender;
-    std::string recipient;
-    std::string address;
-    double weight;
-    int priority; // E.g., 1 (High) to 5 (Low)
-
-    // Operator overload required for Priority Queue [7]: 
-    // Ensures smaller priority number (higher priority) is served first [10].
-    bool operator<(const Parcel& other) const {
-        return priority > other.priority; 
-    }
-};
-
-struct Action {
-    std::string type; 
-    Parcel data;      // Stores the state BEFORE the action was taken (for reversal)
-};
-
-class JumiaLogisticsManager {
-private:
-    // Linked List for dynamic storage, updates, and removal [11, 12]
-    std::list<Parcel> active_parcels;           
-    
-    // Priority Queue for organized loading and urgent delivery handling [7, 12]
-    std::priority_queue<Parcel> loading_queue;  
-    
-    // Stack for undo/redo based on LIFO principle [5, 12]
-    std::stack<Action> undo_stack;              
-    
-    // Dynamic Array (Vector) for delivered parcels and audit trail [9, 12]
-    std::vector<Parcel> delivered_parcels;      
-
-    // Helper function for the Stack (Push operation) [5, 6, 13]
-    void record_action(const std::string& type, const Parcel& p) {
-        Action act = {type, p};
-        undo_stack.push(act);
-    }
-
-public:
-    // MOVED TO PUBLIC to allow interaction/error handling from main()
-    void clear_input() {
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-    }
-
-   
-    void register_parcel_interactive() {
-        Parcel p;
-        std::cout << "\n--- Register New Parcel ---" << std::endl;
-        std::cout << "Enter Parcel ID: ";
-        if (!(std::cin >> p.id)) { clear_input(); std::cout << "Invalid ID." << std::endl; return; }
-        
-        std::cout << "Enter Sender Name: "; 
-        std::cin >> p.sender;
-        
-        std::cout << "Enter Recipient Name: ";
-        std::cin >> p.recipient;
-        
-        std::cout << "Enter Address (no spaces): ";
-        std::cin >> p.address;
-        
-        std::cout << "Enter Weight (kg): ";
-        if (!(std::cin >> p.weight)) { clear_input(); std::cout << "Invalid weight." << std::endl; return; }
-        
-        std::cout << "Enter Delivery Priority (1=High, 5=Low): ";
-        if (!(std::cin >> p.priority) || p.priority < 1 || p.priority > 5) { 
-            clear_input(); 
-            std::cout << "Invalid priority. Must be between 1 and 5." << std::endl; 
-            return; 
-        }
-
-        active_parcels.push_back(p); // Insertion at the end of the list [15]
-        record_action("ADD", p);
-        std::cout << "\nSUCCESS: Parcel " << p.id << " registered and recorded for undo." << std::endl;
-    }
-
-    // 2. Update Parcel (Linked List Traversal and Update) [12]
-    void update_parcel_interactive() {
-        int id;
-        double new_weight;
-        std::cout << "\nEnter Parcel ID to Update: ";
-        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
-
-        for (auto it = active_parcels.begin(); it != active_parcels.end(); ++it) {
-            if (it->id == id) {
-                Parcel old_data = *it; // Store state for undo (UPDATE operation records previous state)
-                
-                std::cout << "Enter New Weight for P" << id << " (Current: " << it->weight << "): ";
-                if (!(std::cin >> new_weight)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
-                
-                it->weight = new_weight; // Update element [16]
-                record_action("UPDATE", old_data);
-                std::cout << "\nSUCCESS: Parcel " << id << " updated." << std::endl;
-                return;
-            }
-        }
-        std::cout << "\nError: Parcel ID " << id << " not found in active records." << std::endl;
-    }
-
-    // 3. Load Parcel (Priority Queue Enqueue)
-    void prepare_for_loading_interactive() {
-        int id;
-        std::cout << "\nEnter Parcel ID to Load onto truck: ";
-        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
-
-        for (const auto& p : active_parcels) {
-            if (p.id == id) {
-                loading_queue.push(p); // Enqueue based on priority
-                std::cout << "\nSUCCESS: Parcel " << id << " loaded (Priority: " << p.priority << "). Will be dispatched based on urgency." << std::endl;
-                return;
-            }
-        }
-        std::cout << "\nError: Parcel ID " << id << " not found." << std::endl;
-    }
-
-    // 4. Dispatch Next Parcel (Priority Queue Dequeue)
-    void dispatch_next_parcel() {
-        if (loading_queue.empty()) {
-            std::cout << "\nERROR: Loading queue is empty. (Underflow) [18]." << std::endl;
-            return;
-        }
-        // Dequeue: Access and remove the highest priority item from the front [7, 17]
-        Parcel next_dispatch = loading_queue.top();
-        loading_queue.pop(); 
-        std::cout << "\nDISPATCH SUCCESS: Parcel ID " << next_dispatch.id << " (Priority " << next_dispatch.priority << ") dispatched immediately." << std::endl;
-    }
-    
-    // 5. Complete Delivery (Linked List Deletion & Array/Vector Insertion) [12, 19]
-    void complete_delivery_interactive() {
-        int id;
-        std::cout << "\nEnter Parcel ID to mark as delivered: ";
-        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
-
-        for (auto it = active_parcels.begin(); it != active_parcels.end(); ++it) {
-            if (it->id == id) {
-                Parcel delivered_p = *it;
-
-                delivered_parcels.push_back(delivered_p); // Audit Array insertion (Requirement 5)
-                active_parcels.erase(it); // Linked List deletion [19]
-
-                record_action("DELETE", delivered_p); // Record deleted item for potential reversal
-                std::cout << "\nSUCCESS: Parcel " << id << " marked delivered and removed from active list." << std::endl;
-                return;
-            }
-        }
-        std::cout << "\nError: Parcel ID " << id << " not found in active list." << std::endl;
-    }
-
-    void undo_last_action() {
-        if (undo_stack.empty()) {
-            std::cout << "\nNO UNDO: Stack is empty (Underflow) [13]. No recent actions recorded." << std::endl;
-            return;
-        }
-
-        // Pop the last action (LIFO) [5, 6]
-        Action last_action = undo_stack.top();
-        undo_stack.pop();
-
-        std::cout << "\n--- Undoing Action: " << last_action.type << " on Parcel ID " << last_action.data.id << " ---" << std::endl;
-
-        // Reversal Logic:
-        if (last_action.type == "ADD") {
-            // Reverse an ADD: Delete the item added (must search the list) [19]
-            for (auto it = active_parcels.begin(); it != active_parcels.end(); ++it) {
-                if (it->id == last_action.data.id) {
-                    active_parcels.erase(it);
-                    std::cout << "UNDO SUCCESS: Registered Parcel " << last_action.data.id << " removed from active list." << std::endl;
-                    return;
-                }
-            }
-        } else if (last_action.type == "DELETE") {
-            // Reverse a DELETE: Re-insert the parcel into the active list [20]
-            active_parcels.push_back(last_action.data);
-            // Note: A full undo requires removing the item from delivered_parcels as well.
-            std::cout << "UNDO SUCCESS: Parcel " << last_action.data.id << " restored to active list." << std::endl;
-        } else if (last_action.type == "UPDATE") {
-            // Reverse an UPDATE: Restore the old data saved in 'last_action.data' [16]
-            for (auto& p : active_parcels) {
-                if (p.id == last_action.data.id) {
-                    p.weight = last_action.data.weight; // Restore old weight
-                    std::cout << "UNDO SUCCESS: Parcel " << last_action.data.id << " weight restored to " << p.weight << "." << std::endl;
-                    return;
-                }
-            }
-        }
-    }
-
-    // 7. Generate Summary Reports (Array/Vector and Linked List Traversal) [12]
-    void generate_summary_reports() const {
-        double total_weight = 0.0;
-        int total_registered = active_parcels.size() + delivered_parcels.size();
-        
-        // Use an array (vector) to count pending parcels by priority
-        std::vector<int> pending_by_priority(6, 0); 
-        
-        // Traversal of active parcels (Linked List)
-        for (const auto& p : active_parcels) {
-            total_weight += p.weight;
-            if (p.priority >= 1 && p.priority <= 5) {
-                pending_by_priority[p.priority]++;
-            }
-        }
-        // Traversal of delivered parcels (Array/Vector)
-        for (const auto& p : delivered_parcels) {
-            total_weight += p.weight;
-        }
-
-        std::cout << "\n--- JUMIA LOGISTICS SUMMARY REPORT ---" << std::endl;
-        std::cout << "Total Parcels Registered: " << total_registered << std::endl;
-        std::cout << "Total Parcels Delivered: " << delivered_parcels.size() << std::endl;
-        
-        // Average parcel weight calculation
-        if (total_registered > 0) {
-            std::cout << "Average Parcel Weight: " << total_weight / total_registered << " kg" << std::endl;
-        }
-        
-        // Parcels pending delivery by priority level
-        std::cout << "\nParcels Pending by Priority Level:" << std::endl;
-        for (int i = 1; i <= 5; ++i) {
-            std::cout << "  Priority " << i << ": " << pending_by_priority[i] << std::endl;
-        }
-        
-        // Delivery History and Route Summary
-        std::cout << "\nDelivery History (Audit Trail - Delivered Parcels):" << std::endl;
-        if (delivered_parcels.empty()) {
-            std::cout << "  No deliveries completed yet." << std::endl;
-        } else {
-            for (const auto& p : delivered_parcels) {
-                std::cout << "  [DELIVERED] P" << p.id << " to " << p.recipient << " (P" << p.priority << ")" << std::endl;
-            }
-        }
-        std::cout << "--------------------------------------" << std::endl;
-    }
-    
-    // 8. Display Menu
-    void display_menu() const {
-        std::cout << "\n=======================================" << std::endl;
-        std::cout << "JUMIA LOGISTICS MANAGEMENT SYSTEM" << std::endl;
-        std::cout << "=======================================" << std::endl;
-        std::cout << "1. Register New Parcel (Linked List Insert)" << std::endl;
-        std::cout << "2. Update Parcel Weight (Linked List Search/Update)" << std::endl;
-        std::cout << "3. Prepare for Loading (Priority Queue Enqueue)" << std::endl;
-        std::cout << "4. Dispatch Next Parcel (Priority Queue Dequeue)" << std::endl;
-        std::cout << "5. Complete Delivery (Linked List Delete & Array Audit)" << std::endl;
-        std::cout << "6. Undo Last Action (Stack Pop/LIFO)" << std::endl;
-        std::cout << "7. Generate Summary Reports" << std::endl;
-        std::cout << "0. Exit Program" << std::endl;
-        std::cout << "Enter choice: ";
-    }
-};
-
-int main() {
-    JumiaLogisticsManager manager;
-    int choice;
-
-    do {
-        manager.display_menu();
-        if (!(std::cin >> choice)) {
-            // Error handling calls the now PUBLIC clear_input()
-            manager.clear_input(); 
-            choice = -1; 
-            std::cout << "Invalid input type. Please enter a number." << std::endl;
-        }
-
-        switch (choice) {
-            case 1: manager.register_parcel_interactive(); break;
-            case 2: manager.update_parcel_interactive(); break;
-            case 3: manager.prepare_for_loading_interactive(); break;
-            case 4: manager.dispatch_next_parcel(); break;
-            case 5: manager.complete_delivery_interactive(); break;
-            case 6: manager.undo_last_action(); break;
-            case 7: manager.generate_summary_reports(); break;
-            case 0: std::cout << "Exiting Jumia Logistics System. Goodbye!" << std::endl; break;
-            default: 
-                if (choice != -1) { // Avoid printing error twice if input failed
-                    std::cout << "Invalid choice. Please try again (0-7)." << std::endl; 
-                }
-                break;
-        }
-    } while (choice != 0);
-
-    return 0;
-}
+#include <iostream>
+#include <string>
+
+#include <queue>        // Provides Priority Queue for prioritized loading [7, 8]
+#include <vector>       // Used as a dynamic Array for audit/reporting [1, 9]
+#include <limits>       // For input cleaning
+#include <cstdlib>      // std::atoi / std::atol for command-line options
+#include <cstddef>      // std::max_align_t
+#include <new>          // std::nothrow, std::bad_alloc, replaceable operator new
+#include <atomic>       // Allocation audit counters
+#include <chrono>       // Benchmark timing
+#include <functional>   // std::less for the loading queue
+#include <cstring>      // std::strcmp / std::strncmp for command-line options
+#include <cstdint>      // Fixed-width fingerprints and file fields
+#include <cstdio>       // std::snprintf for archive segment names
+#include <fstream>      // Archive segments on disk
+#include <algorithm>    // std::sort for archive index builds
+#include <utility>      // std::pair / std::move
+#include <deque>        // Stable storage for interned strings
+#include <unordered_map> // String interning
+#include <type_traits>  // Trivially-copyable checks on records written to disk
+#include <cmath>        // std::llround for kg -> gram conversion
+#include <sstream>      // Parsing rows of bulk import files
+#include <ctime>        // Timestamps in parcel history reports
+#include <thread>       // Parallel action log replay
+#include <memory>       // Shared state of event bus plugins
+#include <mutex>        // Replica state shared between the receiver and the menu
+
+#if defined(__linux__)
+#include <sys/mman.h>   // Huge-page backed arena chunks (mmap / madvise)
+#include <sys/socket.h> // Replication over Unix domain sockets
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>      // Shared-memory view (shm_open)
+#include <sys/stat.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define JUMIA_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define JUMIA_PREFETCH(addr) ((void)0)
+#endif
+
+// Allocation audit. Build with -DJUMIA_ALLOC_AUDIT to replace the global
+// operator new with a counting version; every manager operation then records
+// how many allocations it made (see AllocScope). Without the flag the
+// counters stay at zero and only the call counts are kept.
+std::atomic<uint64_t> g_allocation_count(0);
+std::atomic<uint64_t> g_allocation_bytes(0);
+
+#ifdef JUMIA_ALLOC_AUDIT
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // these *are* the matching operators
+#endif
+void* operator new(std::size_t size) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    g_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    g_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return ::operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
+
+enum OpKind {
+    kOpRegister, kOpUpdate, kOpLoad, kOpDispatch, kOpDeliver, kOpCancel,
+    kOpDispatchBatch, kOpLoadBulk, kOpDeliverBulk, kOpUpdateBulk, kOpUndo, kOpRedo, kOpReplay, kOpCount
+};
+const char* const kOpNames[kOpCount] = {
+    "register", "update", "load", "dispatch", "deliver", "cancel",
+    "dispatch batch", "bulk load", "bulk deliver", "bulk update", "undo", "redo", "log replay"
+};
+
+struct OpAllocStats {
+    uint64_t calls;
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+// Charges the allocations made during its lifetime to one operation's stats
+class AllocScope {
+private:
+    OpAllocStats& stats;
+    uint64_t count_before;
+    uint64_t bytes_before;
+
+public:
+    explicit AllocScope(OpAllocStats& op)
+        : stats(op),
+          count_before(g_allocation_count.load(std::memory_order_relaxed)),
+          bytes_before(g_allocation_bytes.load(std::memory_order_relaxed)) {}
+    ~AllocScope() {
+        ++stats.calls;
+        stats.allocations += g_allocation_count.load(std::memory_order_relaxed) - count_before;
+        stats.bytes += g_allocation_bytes.load(std::memory_order_relaxed) - bytes_before;
+    }
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+};
+
+// Where an Arena gets its chunks from (see --huge-pages).
+// Transparent: 2 MiB-aligned anonymous mappings marked MADV_HUGEPAGE.
+// Explicit: MAP_HUGETLB from the reserved pool (vm.nr_hugepages), falling back
+// to Transparent when the pool is empty. Both fall back to the heap when
+// mapping fails, and always on non-Linux builds.
+enum class HugePages : uint8_t { Off, Transparent, Explicit };
+const size_t kHugePageSize = 2u << 20;
+
+inline const char* huge_pages_name(HugePages mode) {
+    switch (mode) {
+        case HugePages::Off: return "off";
+        case HugePages::Transparent: return "transparent";
+        case HugePages::Explicit: return "explicit";
+    }
+    return "?";
+}
+
+struct HugePageStats {
+    size_t pages;      // 2 MiB pages mapped for huge-page chunks
+    size_t huge_pages; // of those, pages the kernel actually backs with huge pages
+};
+
+// Bump allocator: hands out memory from large chunks and frees nothing
+// individually. reset() rewinds to the first chunk and keeps every chunk for
+// reuse, so once warmed up it never allocates again. Requests bigger than the
+// chunk size get a chunk of their own.
+class Arena {
+private:
+    enum ChunkSource : uint8_t { kHeapChunk, kTransparentChunk, kHugeTlbChunk };
+    struct Chunk {
+        char* base;
+        size_t size;
+        ChunkSource source;
+    };
+    std::vector<Chunk> chunks;
+    size_t chunk_size;
+    HugePages huge_pages;
+    size_t current = 0; // chunk being carved
+    size_t offset = 0;  // bytes used in chunks[current]
+
+    // Maps huge-page memory when enabled (size rounded up to whole 2 MiB pages),
+    // otherwise takes the chunk from the heap
+    Chunk acquire(size_t size) {
+        Chunk c = { nullptr, size, kHeapChunk };
+#if defined(__linux__)
+        if (huge_pages != HugePages::Off) {
+            size_t mapped = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+#ifdef MAP_HUGETLB
+            if (huge_pages == HugePages::Explicit) {
+                void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (p != MAP_FAILED) {
+                    c.base = static_cast<char*>(p);
+                    c.size = mapped;
+                    c.source = kHugeTlbChunk;
+                    return c;
+                }
+            }
+#endif
+            // Over-map by one page and trim, so the chunk starts on a 2 MiB boundary
+            void* raw = mmap(nullptr, mapped + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw != MAP_FAILED) {
+                uintptr_t start = (reinterpret_cast<uintptr_t>(raw) + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1);
+                size_t head = start - reinterpret_cast<uintptr_t>(raw);
+                if (head > 0) munmap(raw, head);
+                munmap(reinterpret_cast<char*>(start) + mapped, kHugePageSize - head);
+                c.base = reinterpret_cast<char*>(start);
+                c.size = mapped;
+                c.source = kTransparentChunk;
+#ifdef MADV_HUGEPAGE
+                madvise(c.base, mapped, MADV_HUGEPAGE);
+#endif
+                // Fault each page in now, while the kernel can still hand out a whole 2 MiB page
+                for (size_t page = 0; page < mapped; page += kHugePageSize) c.base[page] = 0;
+                return c;
+            }
+        }
+#endif
+        c.base = static_cast<char*>(::operator new(size, std::nothrow));
+        return c;
+    }
+
+    static void release(const Chunk& c) {
+#if defined(__linux__)
+        if (c.source != kHeapChunk) { munmap(c.base, c.size); return; }
+#endif
+        ::operator delete(c.base);
+    }
+
+    // Sum of AnonHugePages over the mappings holding transparent chunks, from
+    // /proc/self/smaps. The kernel may merge neighbouring mappings, so this can
+    // include huge pages of an adjacent arena; callers cap it at their page count.
+    size_t transparent_huge_bytes() const {
+        size_t total = 0;
+#if defined(__linux__)
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        bool ours = false;
+        while (std::getline(smaps, line)) {
+            unsigned long long begin = 0, end = 0;
+            unsigned long kb = 0;
+            if (std::sscanf(line.c_str(), "%llx-%llx ", &begin, &end) == 2) {
+                ours = false;
+                for (const Chunk& c : chunks) {
+                    uintptr_t base = reinterpret_cast<uintptr_t>(c.base);
+                    if (c.source == kTransparentChunk && base < end && base + c.size > begin) { ours = true; break; }
+                }
+            } else if (ours && std::sscanf(line.c_str(), "AnonHugePages: %lu kB", &kb) == 1) {
+                total += (size_t)kb * 1024;
+            }
+        }
+#endif
+        return total;
+    }
+
+public:
+    explicit Arena(size_t chunk_bytes = 64 * 1024, HugePages pages = HugePages::Off)
+        : chunk_size(chunk_bytes), huge_pages(pages) {}
+    ~Arena() { for (const Chunk& c : chunks) release(c); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        while (true) {
+            if (current < chunks.size()) {
+                const Chunk& c = chunks[current];
+                uintptr_t base = reinterpret_cast<uintptr_t>(c.base);
+                uintptr_t start = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+                if (start + bytes <= base + c.size) {
+                    offset = start + bytes - base;
+                    return reinterpret_cast<void*>(start);
+                }
+                if (current + 1 < chunks.size()) { ++current; offset = 0; continue; }
+            }
+            Chunk c = acquire(std::max(chunk_size, bytes + align));
+            if (!c.base) return nullptr;
+            chunks.push_back(c);
+            current = chunks.size() - 1;
+            offset = 0;
+        }
+    }
+
+    void reset() { current = 0; offset = 0; }
+
+    // Acquires chunks up front so that at least 'bytes' more can be carved without allocating
+    void reserve(size_t bytes) {
+        size_t room = current < chunks.size() ? chunks[current].size - offset : 0;
+        for (size_t i = current + 1; i < chunks.size(); ++i) room += chunks[i].size;
+        chunks.reserve(chunks.size() + bytes / chunk_size + 1);
+        while (room < bytes) {
+            Chunk c = acquire(chunk_size);
+            if (!c.base) return;
+            chunks.push_back(c);
+            room += c.size;
+        }
+    }
+
+    size_t bytes_reserved() const {
+        size_t total = 0;
+        for (const Chunk& c : chunks) total += c.size;
+        return total;
+    }
+
+    HugePageStats huge_page_stats() const {
+        HugePageStats stats = { 0, 0 };
+        size_t transparent_pages = 0;
+        for (const Chunk& c : chunks) {
+            if (c.source == kHeapChunk) continue;
+            stats.pages += c.size / kHugePageSize;
+            if (c.source == kHugeTlbChunk) stats.huge_pages += c.size / kHugePageSize;
+            else transparent_pages += c.size / kHugePageSize;
+        }
+        if (transparent_pages > 0) {
+            stats.huge_pages += std::min(transparent_huge_bytes() / kHugePageSize, transparent_pages);
+        }
+        return stats;
+    }
+};
+
+// Standard allocator over an Arena, for containers in zero-allocation mode.
+// With a null arena it falls back to the global heap. deallocate() is a no-op
+// on an arena: a buffer the container outgrows or replaces stays there until
+// the arena is reset. Only containers reserved up front, or grown by doubling
+// (at most their final size again), belong on one; rebuilt ones use the heap.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    ArenaAllocator(Arena* a = nullptr) : arena(a) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (!arena) return static_cast<T*>(::operator new(n * sizeof(T)));
+        void* p = arena->allocate(n * sizeof(T), alignof(T));
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) {
+        if (!arena) ::operator delete(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+// Interned storage for the rare text values too long to fit inline.
+// Values are never freed, so an index stays valid for the life of the process.
+class StringPool {
+private:
+    std::deque<std::string> values;
+    std::unordered_map<std::string, uint32_t> lookup;
+
+public:
+    uint32_t intern(const std::string& s) {
+        auto found = lookup.find(s);
+        if (found != lookup.end()) return found->second;
+        uint32_t index = (uint32_t)values.size();
+        values.push_back(s);
+        lookup[s] = index;
+        return index;
+    }
+    const std::string& get(uint32_t index) const { return values[index]; }
+    size_t size() const { return values.size(); }
+};
+
+inline StringPool& string_pool() {
+    static StringPool pool;
+    return pool;
+}
+
+// Fixed-capacity text field stored inside the record itself (24 bytes). Values
+// longer than kCapacity are interned in string_pool() and referenced by index,
+// so records holding these stay trivially copyable.
+class InlineString {
+public:
+    static const size_t kCapacity = 23;
+
+private:
+    static const uint8_t kPooled = 0xFF;
+    char chars[kCapacity]; // unused bytes stay zero, so records hash and write deterministically
+    uint8_t len;
+
+public:
+    InlineString() : chars(), len(0) {}
+
+    void assign(const std::string& s) {
+        std::memset(chars, 0, kCapacity);
+        if (s.size() <= kCapacity) {
+            std::memcpy(chars, s.data(), s.size());
+            len = (uint8_t)s.size();
+        } else {
+            set_pool_index(string_pool().intern(s));
+        }
+    }
+
+    bool pooled() const { return len == kPooled; }
+    uint32_t pool_index() const { uint32_t index; std::memcpy(&index, chars, sizeof(index)); return index; }
+    void set_pool_index(uint32_t index) { std::memcpy(chars, &index, sizeof(index)); len = kPooled; }
+
+    const char* data() const { return pooled() ? string_pool().get(pool_index()).data() : chars; }
+    size_t size() const { return pooled() ? string_pool().get(pool_index()).size() : len; }
+    std::string str() const { return std::string(data(), size()); }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const InlineString& s) {
+    return os.write(s.data(), (std::streamsize)s.size());
+}
+
+inline std::istream& operator>>(std::istream& is, InlineString& s) {
+    std::string word;
+    if (is >> word) s.assign(word);
+    return is;
+}
+
+// Fixed-point parcel weight in whole grams. Integer sums are exact and come out
+// identical however they are split up or ordered, so totals never drift.
+class Weight {
+private:
+    int64_t g;
+
+public:
+    static const int64_t kMaxGrams = 4000000000LL; // hot records keep grams in 32 bits
+
+    Weight() : g(0) {}
+    static Weight from_grams(int64_t grams) { Weight w; w.g = grams; return w; }
+    static Weight from_kg(double kg) { return from_grams((int64_t)std::llround(kg * 1000.0)); }
+
+    int64_t grams() const { return g; }
+    double kg() const { return g / 1000.0; }
+    bool valid() const { return g >= 0 && g <= kMaxGrams; }
+};
+
+// Prints kilograms exactly, e.g. 2500 g -> "2.5", 3 g -> "0.003"
+inline std::ostream& operator<<(std::ostream& os, const Weight& w) {
+    int64_t grams = w.grams();
+    if (grams < 0) { os << '-'; grams = -grams; }
+    os << grams / 1000;
+    int frac = (int)(grams % 1000);
+    if (frac != 0) {
+        char digits[5];
+        std::snprintf(digits, sizeof(digits), ".%03d", frac);
+        size_t len = std::strlen(digits);
+        while (digits[len - 1] == '0') --len;
+        os.write(digits, (std::streamsize)len);
+    }
+    return os;
+}
+
+// Reads kilograms, rounded to the nearest gram; out-of-range values fail the stream
+inline std::istream& operator>>(std::istream& is, Weight& w) {
+    double kg;
+    if (is >> kg) {
+        Weight parsed = Weight::from_kg(kg);
+        if (kg < 0 || !parsed.valid()) is.setstate(std::ios::failbit);
+        else w = parsed;
+    }
+    return is;
+}
+
+// Define the Parcel Structure (Requirement 1)
+// Trivially copyable: containers copy it with memcpy and the archive writes it as-is.
+// Numeric fields come first so the layout has no padding.
+struct Parcel {
+    int id;
+    int priority; // E.g., 1 (High) to 5 (Low)
+    Weight weight;
+    InlineString sender;
+    InlineString recipient;
+    InlineString address;
+
+    // Operator overload required for Priority Queue [7]: 
+    // Ensures smaller priority number (higher priority) is served first [10].
+    bool operator<(const Parcel& other) const {
+        return priority > other.priority; 
+    }
+};
+static_assert(std::is_trivially_copyable<Parcel>::value, "Parcel is copied and written to disk as raw bytes");
+static_assert(sizeof(Parcel) == 88, "Parcel layout must not contain padding");
+
+// Startup options for the manager (set from the command line in main)
+struct ManagerConfig {
+    bool auto_ids = false; // Manager issues dense ids instead of asking the operator
+    int shard = 0;         // Shard number stored in the high bits of every issued id
+    std::string archive_prefix = "jumia_archive"; // Sealed segments are <prefix>_0001.dat, ...
+    bool zero_alloc = false;    // Containers allocate from one storage arena, reserved up front
+    size_t reserve_parcels = 0; // Capacity to reserve (parcels in flight / undo entries)
+    HugePages huge_pages = HugePages::Off; // Back the storage arena and archive indexes with 2 MiB pages
+    unsigned replay_threads = 0; // Action log replay threads (0 = one per core)
+    std::string cdc_prefix;      // Change stream segments <prefix>_000001.cdc, ... (empty: off)
+    std::string replicate_path;  // Serve replicas on this Unix socket (empty: off)
+    std::string replica_of;      // Run as a read-only replica of the primary on this socket (empty: primary)
+    std::string shm_name;        // Publish a read-only shared-memory view under this name (empty: off)
+    bool persist_history = true; // Keep the version journal in <archive_prefix>_history_*.cdc across runs
+};
+
+// Dense id layout: [shard (7 bits)][sequence (24 bits)].
+// Each shard issues its own gap-free sequence, so ids never collide across shards.
+const int kShardBits = 24;
+const int kMaxShard = 127;
+const int kSequenceMask = (1 << kShardBits) - 1;
+
+// Cuckoo filter over parcel ids: answers "definitely never seen" from memory.
+// 16-bit fingerprints in 4-slot buckets (~0.01% false positives); unlike a
+// Bloom filter it supports erase(), which undo needs.
+class CuckooFilter {
+private:
+    static const int kSlots = 4;
+    static const int kMaxKicks = 500;
+    std::vector<uint16_t, ArenaAllocator<uint16_t> > table; // bucket b occupies table[b * kSlots] .. table[b * kSlots + 3]
+    size_t bucket_mask = 0;
+    size_t item_count = 0;
+
+    static uint64_t mix(uint64_t x) { // splitmix64 finaliser
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+    static uint16_t fingerprint(uint64_t h) {
+        uint16_t fp = (uint16_t)(h >> 48);
+        return fp == 0 ? 1 : fp; // 0 marks an empty slot
+    }
+    size_t alt_bucket(size_t bucket, uint16_t fp) const {
+        return (bucket ^ (size_t)mix(fp)) & bucket_mask;
+    }
+    bool bucket_has(size_t bucket, uint16_t fp) const {
+        for (int i = 0; i < kSlots; ++i) if (table[bucket * kSlots + i] == fp) return true;
+        return false;
+    }
+    bool bucket_put(size_t bucket, uint16_t fp) {
+        for (int i = 0; i < kSlots; ++i) {
+            if (table[bucket * kSlots + i] == 0) { table[bucket * kSlots + i] = fp; return true; }
+        }
+        return false;
+    }
+    bool bucket_remove(size_t bucket, uint16_t fp) {
+        for (int i = 0; i < kSlots; ++i) {
+            if (table[bucket * kSlots + i] == fp) { table[bucket * kSlots + i] = 0; return true; }
+        }
+        return false;
+    }
+
+public:
+    explicit CuckooFilter(size_t expected_items = 1024, Arena* arena = nullptr)
+        : table(ArenaAllocator<uint16_t>(arena)) { reset(expected_items); }
+
+    void reset(size_t expected_items) {
+        size_t buckets = 1;
+        while (buckets * kSlots * 9 / 10 < expected_items) buckets <<= 1; // keep load under 90%
+        table.assign(buckets * kSlots, 0);
+        bucket_mask = buckets - 1;
+        item_count = 0;
+    }
+
+    // Returns false when the table is too full; the caller then rebuilds it larger
+    bool insert(int id) {
+        uint64_t h = mix((uint32_t)id);
+        uint16_t fp = fingerprint(h);
+        size_t b1 = h & bucket_mask;
+        size_t b2 = alt_bucket(b1, fp);
+        if (bucket_put(b1, fp) || bucket_put(b2, fp)) { ++item_count; return true; }
+
+        // Both buckets full: evict fingerprints along a cuckoo path
+        size_t b = ((h >> 20) & 1) ? b1 : b2;
+        for (int kick = 0; kick < kMaxKicks; ++kick) {
+            uint16_t& victim = table[b * kSlots + (kick % kSlots)];
+            uint16_t evicted = victim;
+            victim = fp;
+            fp = evicted;
+            b = alt_bucket(b, fp);
+            if (bucket_put(b, fp)) { ++item_count; return true; }
+        }
+        return false; // One fingerprint is homeless; the rebuild re-inserts every id anyway
+    }
+
+    bool might_contain(int id) const {
+        uint64_t h = mix((uint32_t)id);
+        uint16_t fp = fingerprint(h);
+        size_t b1 = h & bucket_mask;
+        return bucket_has(b1, fp) || bucket_has(alt_bucket(b1, fp), fp);
+    }
+
+    // Only call for ids that were inserted, otherwise another id's fingerprint may go
+    void erase(int id) {
+        uint64_t h = mix((uint32_t)id);
+        uint16_t fp = fingerprint(h);
+        size_t b1 = h & bucket_mask;
+        if (bucket_remove(b1, fp) || bucket_remove(alt_bucket(b1, fp), fp)) --item_count;
+    }
+
+    size_t size() const { return item_count; }
+    size_t capacity() const { return table.size(); }
+};
+
+// Static search index over the ids of one sealed archive segment.
+// Keys are kept in Eytzinger (BFS) order: node k has children 2k and 2k+1, so
+// the top levels of every search share the same few cache lines, and the 16
+// keys four levels below node k sit together in one 64-byte line.
+class EytzingerIndex {
+private:
+    std::vector<int, ArenaAllocator<int> > storage;           // padded so that keys[0] starts a cache line
+    std::vector<uint32_t, ArenaAllocator<uint32_t> > offsets; // file offset of each record, in key order (1-based)
+    size_t base = 0;                // keys[k] == storage[base + k]
+    size_t n = 0;
+
+    const int* keys() const { return storage.data() + base; }
+
+    // Fills the BFS layout with an in-order walk over the sorted input
+    size_t fill(const std::vector<std::pair<int, uint32_t> >& sorted, size_t i, size_t k) {
+        if (k <= n) {
+            i = fill(sorted, i, 2 * k);
+            storage[base + k] = sorted[i].first;
+            offsets[k] = sorted[i].second;
+            ++i;
+            i = fill(sorted, i, 2 * k + 1);
+        }
+        return i;
+    }
+
+public:
+    explicit EytzingerIndex(Arena* arena = nullptr)
+        : storage(ArenaAllocator<int>(arena)), offsets(ArenaAllocator<uint32_t>(arena)) {}
+
+    void build(std::vector<std::pair<int, uint32_t> > entries) {
+        std::sort(entries.begin(), entries.end());
+        n = entries.size();
+        storage.assign(n + 1 + 16, 0);
+        size_t misalign = (reinterpret_cast<uintptr_t>(storage.data()) / sizeof(int)) % 16;
+        // &keys[0] lands on a 64-byte boundary, so every block keys[16k..16k+15]
+        // (the descendants find() prefetches) is exactly one cache line
+        base = (16 - misalign) % 16;
+        storage.resize(base + n + 1); // shrinks only, so the buffer stays put
+        offsets.assign(n + 1, 0);
+        fill(entries, 0, 1);
+    }
+
+    // Branchless lower-bound descent; returns false when id is not in the segment
+    bool find(int id, uint32_t& offset) const {
+        const int* t = keys();
+        size_t k = 1;
+        while (k <= n) {
+            if (16 * k <= n) JUMIA_PREFETCH(t + 16 * k); // grandchildren four levels down
+            k = 2 * k + (t[k] < id);
+        }
+        // Undo the trailing right turns to land on the lower-bound node
+        while (k & 1) k >>= 1;
+        k >>= 1;
+        if (k == 0 || t[k] != id) return false;
+        offset = offsets[k];
+        return true;
+    }
+
+    template <typename IdVisitor>
+    void for_each_id(IdVisitor on_id) const {
+        for (size_t k = 1; k <= n; ++k) on_id(keys()[k]);
+    }
+
+    size_t size() const { return n; }
+    size_t memory_bytes() const { return storage.capacity() * sizeof(int) + offsets.capacity() * sizeof(uint32_t); }
+};
+
+// Sealed, immutable segments of delivered parcels on disk.
+// Segment layout: magic, record count (u32), string table offset (u32),
+// the Parcel records written as raw bytes, then the string table holding every
+// pooled (long) text value the records refer to: count (u32), then per entry
+// pool index (u32), length (u32) and the bytes. The current format is "JLA3".
+// Segments from older builds are still readable: "JLA2" is the same layout with
+// the weight stored as double kilograms, "JLA1" stored id, priority, weight
+// (double kg) and three length-prefixed strings per record.
+class ParcelArchive {
+private:
+    std::string prefix;
+    Arena* index_arena; // Backing for the segment id indexes (null: heap)
+    int segment_count = 0;
+    size_t record_count = 0;
+    int64_t weight_total_g = 0;
+
+    // One in-memory id index per segment, with the segment's id range for a quick reject
+    struct SegmentIndex {
+        int version;
+        int min_id;
+        int max_id;
+        EytzingerIndex ids;
+        // Pool index written in the file -> pool index in this process, sorted by the first
+        std::vector<std::pair<uint32_t, uint32_t> > string_remap;
+
+        explicit SegmentIndex(Arena* arena) : version(0), min_id(0), max_id(0), ids(arena) {}
+    };
+    std::vector<SegmentIndex> indexes; // indexes[n - 1] covers segment n
+
+    std::string segment_path(int n) const {
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), "_%04d.dat", n);
+        return prefix + suffix;
+    }
+
+    template <typename T>
+    static bool read_value(std::ifstream& in, T& value) {
+        return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+    template <typename T>
+    static void write_value(std::ofstream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static bool read_string(std::ifstream& in, InlineString& s) {
+        uint32_t len = 0;
+        if (!read_value(in, len)) return false;
+        std::string text(len, '\0');
+        if (len > 0 && !in.read(&text[0], len)) return false;
+        s.assign(text);
+        return true;
+    }
+    static bool read_legacy_record(std::ifstream& in, Parcel& p) {
+        p = Parcel();
+        double kg = 0.0;
+        read_value(in, p.id);
+        read_value(in, p.priority);
+        read_value(in, kg);
+        p.weight = Weight::from_kg(kg);
+        return in && read_string(in, p.sender) && read_string(in, p.recipient) && read_string(in, p.address);
+    }
+
+    static void remap_field(const SegmentIndex& index, InlineString& s) {
+        if (!s.pooled()) return;
+        auto pos = std::lower_bound(index.string_remap.begin(), index.string_remap.end(),
+                                    std::make_pair(s.pool_index(), (uint32_t)0));
+        if (pos != index.string_remap.end() && pos->first == s.pool_index()) s.set_pool_index(pos->second);
+        else s.assign(std::string()); // dangling reference in a damaged segment
+    }
+    // JLA2 kept the weight as double kilograms in the same 8 bytes
+    static void upgrade_weight(Parcel& p) {
+        double kg;
+        std::memcpy(&kg, &p.weight, sizeof(kg));
+        p.weight = Weight::from_kg(kg);
+    }
+
+    static bool read_record(std::ifstream& in, const SegmentIndex& index, Parcel& p) {
+        if (index.version == 1) return read_legacy_record(in, p);
+        if (!read_value(in, p)) return false;
+        if (index.version == 2) upgrade_weight(p);
+        remap_field(index, p.sender);
+        remap_field(index, p.recipient);
+        remap_field(index, p.address);
+        return true;
+    }
+
+    // Reads the header; returns the format version (0 when this is not a segment)
+    static int open_segment(std::ifstream& in, uint32_t& count, uint32_t& strings_offset) {
+        char magic[4];
+        if (!in.read(magic, 4) || std::strncmp(magic, "JLA", 3) != 0) return 0;
+        if (!read_value(in, count)) return 0;
+        if (magic[3] == '1') return 1;
+        if ((magic[3] != '2' && magic[3] != '3') || !read_value(in, strings_offset)) return 0;
+        return magic[3] - '0';
+    }
+
+    static void note_pooled(const InlineString& s, std::vector<uint32_t>& pooled) {
+        if (s.pooled()) pooled.push_back(s.pool_index());
+    }
+
+    void add_index(SegmentIndex& index, const std::vector<std::pair<int, uint32_t> >& entries) {
+        index.min_id = std::numeric_limits<int>::max();
+        index.max_id = std::numeric_limits<int>::min();
+        for (const auto& e : entries) {
+            index.min_id = std::min(index.min_id, e.first);
+            index.max_id = std::max(index.max_id, e.first);
+        }
+        index.ids.build(entries);
+        std::sort(index.string_remap.begin(), index.string_remap.end());
+        indexes.push_back(std::move(index)); // moved, not copied, to keep the key alignment
+    }
+
+public:
+    explicit ParcelArchive(const std::string& path_prefix, Arena* arena = nullptr)
+        : prefix(path_prefix), index_arena(arena) {}
+
+    // Picks up segments sealed by earlier runs and indexes them (one sequential
+    // read per segment at startup); calls on_id for every archived id
+    template <typename IdVisitor>
+    void load_existing(IdVisitor on_id) {
+        segment_count = 0;
+        record_count = 0;
+        weight_total_g = 0;
+        indexes.clear();
+        if (index_arena) index_arena->reset(); // the arena holds nothing but these indexes
+        while (true) {
+            std::ifstream in(segment_path(segment_count + 1).c_str(), std::ios::binary);
+            uint32_t count = 0, strings_offset = 0;
+            SegmentIndex index(index_arena);
+            index.version = open_segment(in, count, strings_offset);
+            if (index.version == 0) break;
+
+            std::vector<std::pair<int, uint32_t> > entries;
+            entries.reserve(count);
+            if (index.version == 1) {
+                Parcel p;
+                for (uint32_t i = 0; i < count; ++i) {
+                    uint32_t offset = (uint32_t)in.tellg();
+                    if (!read_legacy_record(in, p)) break;
+                    entries.push_back(std::make_pair(p.id, offset));
+                    weight_total_g += p.weight.grams();
+                }
+            } else {
+                // Fixed-size records: one bulk read, then the string table
+                uint32_t first = (uint32_t)in.tellg();
+                std::vector<Parcel> records(count);
+                if (count > 0 && !in.read(reinterpret_cast<char*>(&records[0]), count * sizeof(Parcel))) records.clear();
+                for (size_t i = 0; i < records.size(); ++i) {
+                    if (index.version == 2) upgrade_weight(records[i]);
+                    entries.push_back(std::make_pair(records[i].id, first + (uint32_t)(i * sizeof(Parcel))));
+                    weight_total_g += records[i].weight.grams();
+                }
+                uint32_t strings = 0;
+                in.seekg(strings_offset);
+                read_value(in, strings);
+                for (uint32_t i = 0; i < strings; ++i) {
+                    uint32_t old_index = 0, len = 0;
+                    if (!read_value(in, old_index) || !read_value(in, len)) break;
+                    std::string text(len, '\0');
+                    if (len > 0 && !in.read(&text[0], len)) break;
+                    index.string_remap.push_back(std::make_pair(old_index, string_pool().intern(text)));
+                }
+            }
+            record_count += entries.size();
+            add_index(index, entries);
+            ++segment_count;
+            // Only once the segment is indexed: a filter that fills up in on_id is
+            // rebuilt from the archive indexes and must see these ids too
+            for (const auto& e : entries) on_id(e.first);
+        }
+    }
+
+    // Served from the in-memory indexes; no disk access
+    template <typename IdVisitor>
+    void for_each_id(IdVisitor on_id) const {
+        for (const auto& index : indexes) index.ids.for_each_id(on_id);
+    }
+
+    // Writes 'parcels' records as the next immutable segment. Each call to
+    // next_parcel() returns the next record, which is streamed straight to the
+    // file; nothing is gathered first.
+    template <typename ParcelSource>
+    bool seal(size_t parcels, ParcelSource next_parcel) {
+        std::string path = segment_path(segment_count + 1);
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        uint32_t count = (uint32_t)parcels;
+        uint32_t header = 4 + 2 * sizeof(uint32_t);
+        uint32_t strings_offset = header + count * (uint32_t)sizeof(Parcel);
+        out.write("JLA3", 4);
+        write_value(out, count);
+        write_value(out, strings_offset);
+
+        std::vector<uint32_t> pooled;
+        std::vector<std::pair<int, uint32_t> > entries;
+        entries.reserve(parcels);
+        int64_t sealed_weight_g = 0;
+        for (size_t i = 0; i < parcels; ++i) {
+            Parcel p = next_parcel();
+            write_value(out, p);
+            entries.push_back(std::make_pair(p.id, header + (uint32_t)(i * sizeof(Parcel))));
+            sealed_weight_g += p.weight.grams();
+            note_pooled(p.sender, pooled);
+            note_pooled(p.recipient, pooled);
+            note_pooled(p.address, pooled);
+        }
+        std::sort(pooled.begin(), pooled.end());
+        pooled.erase(std::unique(pooled.begin(), pooled.end()), pooled.end());
+        write_value(out, (uint32_t)pooled.size());
+        SegmentIndex index(index_arena);
+        index.version = 3;
+        for (uint32_t pool_index : pooled) {
+            const std::string& text = string_pool().get(pool_index);
+            write_value(out, pool_index);
+            write_value(out, (uint32_t)text.size());
+            out.write(text.data(), text.size());
+            index.string_remap.push_back(std::make_pair(pool_index, pool_index));
+        }
+        if (!out.flush()) return false;
+        add_index(index, entries);
+        ++segment_count;
+        record_count += parcels;
+        weight_total_g += sealed_weight_g;
+        return true;
+    }
+
+    // Point lookup: index search per segment (newest first), then a single record read
+    bool find(int id, Parcel& out) const {
+        for (size_t s = indexes.size(); s-- > 0;) {
+            const SegmentIndex& index = indexes[s];
+            if (id < index.min_id || id > index.max_id) continue;
+            uint32_t offset;
+            if (!index.ids.find(id, offset)) continue;
+            std::ifstream in(segment_path((int)s + 1).c_str(), std::ios::binary);
+            in.seekg(offset);
+            return read_record(in, index, out);
+        }
+        return false;
+    }
+
+    int segments() const { return segment_count; }
+    size_t size() const { return record_count; }
+    Weight total_weight() const { return Weight::from_grams(weight_total_g); }
+};
+
+// Split representation of a parcel held by the manager. The 16-byte hot record
+// carries everything queueing, dispatch and the reports need; the three text
+// fields live in a separate cold store reached through the 'cold' handle.
+const uint32_t kNoSlot = 0xFFFFFFFFu;
+
+// Parcel lifecycle: Registered -> Loaded -> Dispatched -> Delivered, with
+// Cancelled reachable from any of the three active states. Free marks an
+// unused slot. Delivered parcels stay in memory until they are archived.
+enum class ParcelState : uint8_t { Free, Registered, Loaded, Dispatched, Delivered, Cancelled };
+const int kStateCount = 6;
+
+inline const char* state_name(ParcelState state) {
+    switch (state) {
+        case ParcelState::Free: return "FREE";
+        case ParcelState::Registered: return "REGISTERED";
+        case ParcelState::Loaded: return "LOADED";
+        case ParcelState::Dispatched: return "DISPATCHED";
+        case ParcelState::Delivered: return "DELIVERED";
+        case ParcelState::Cancelled: return "CANCELLED";
+    }
+    return "?";
+}
+
+// Registered, Loaded or Dispatched (a single unsigned compare, so it stays branch-free)
+inline bool is_active(ParcelState state) {
+    return (uint8_t)((uint8_t)state - (uint8_t)ParcelState::Registered) < 3;
+}
+
+struct ParcelHot {
+    int32_t id;
+    uint32_t weight_g;  // Weight in grams (Weight::kMaxGrams fits)
+    uint32_t cold;      // index into ParcelStore's cold store
+    uint8_t priority;
+    ParcelState state;
+    uint16_t spare;
+};
+static_assert(sizeof(ParcelHot) == 16, "ParcelHot must stay 16 bytes (four per cache line)");
+
+struct ParcelCold {
+    InlineString sender;
+    InlineString recipient;
+    InlineString address;
+};
+
+// Per-slot links of the intrusive state lists (kept beside the hot array so
+// hot records stay 16 bytes)
+struct ParcelLink {
+    uint32_t prev;
+    uint32_t next;
+};
+
+// Why a parcel version was written: a normal operation, an undo or redo, or archiving
+enum class VersionOrigin : uint8_t { Operation, Undo, Redo, Archive, Replay, Restart };
+
+inline const char* origin_name(VersionOrigin origin) {
+    switch (origin) {
+        case VersionOrigin::Operation: return "";
+        case VersionOrigin::Undo: return " (undo)";
+        case VersionOrigin::Redo: return " (redo)";
+        case VersionOrigin::Archive: return "";
+        case VersionOrigin::Replay: return " (log replay)";
+        case VersionOrigin::Restart: return " (not kept across restart)";
+    }
+    return "";
+}
+
+const uint8_t kVersionState = 1;  // ParcelVersion::state is set
+const uint8_t kVersionWeight = 2; // ParcelVersion::weight_g is set
+
+// One entry of a parcel's history: only the fields that changed (flagged in
+// 'fields'), when, and a back-pointer to the parcel's previous version
+struct ParcelVersion {
+    const ParcelVersion* prev;
+    int64_t time_ms;   // wall clock, ms since the epoch
+    VersionOrigin origin;
+    uint8_t fields;
+    ParcelState state;
+    uint8_t spare;
+    uint32_t weight_g;
+};
+static_assert(sizeof(ParcelVersion) == 24, "History entries must stay compact");
+
+// A parcel as of some moment, rebuilt from the history
+struct ParcelImage {
+    int32_t id;
+    uint32_t weight_g;
+    ParcelState state; // Free: sealed into the archive
+};
+
+// Every parcel's image after the first 'position' journal records: a replay
+// snapshot (not to be confused with the undo checkpoint of menu 10)
+struct ReplaySnapshot {
+    int64_t time_ms;  // time of the last record folded in
+    size_t position;
+    std::vector<ParcelImage> parcels; // sorted by id
+};
+
+// Fewest journal records between two replay snapshots
+const size_t kMinSnapshotInterval = 4096;
+
+// One change data capture record: a parcel mutation as downstream systems
+// (billing, notifications) see it. Written to disk as raw bytes.
+struct CdcRecord {
+    uint64_t sequence; // 1, 2, 3, ... without gaps, across segments and runs
+    int64_t time_ms;   // wall clock, ms since the epoch
+    int32_t id;
+    uint32_t weight_g; // set when 'fields' has kVersionWeight
+    uint8_t fields;    // kVersionState / kVersionWeight, as in ParcelVersion
+    ParcelState state; // set when 'fields' has kVersionState (Free: archived or removed)
+    VersionOrigin origin;
+    uint8_t spare[5];
+};
+static_assert(std::is_trivially_copyable<CdcRecord>::value, "CDC records are written to disk as raw bytes");
+static_assert(sizeof(CdcRecord) == 32, "CDC records must stay compact");
+
+// Records per CDC segment: sequence s lives in segment (s - 1) / kCdcSegmentRecords + 1
+const uint64_t kCdcSegmentRecords = 65536;
+// Records the producer can run ahead of the writer thread (a power of two)
+const size_t kCdcRingRecords = 8192;
+
+// CDC segment layout: magic "JCD1", record size (u32), first sequence (u64),
+// then the records. Segments are only ever appended to, and a segment is full
+// once it holds kCdcSegmentRecords records.
+const size_t kCdcHeaderBytes = 16;
+
+inline std::string cdc_segment_path(const std::string& prefix, uint64_t n) {
+    char suffix[32]; // room for any 64-bit segment number
+    std::snprintf(suffix, sizeof(suffix), "_%06llu.cdc", (unsigned long long)n);
+    return prefix + suffix;
+}
+
+// Append-only change stream. The operation path only copies a record into a
+// single-producer/single-consumer ring; a writer thread drains the ring into
+// segment files and flushes after every drain, so consumers tailing the files
+// see each change within a few milliseconds. When the ring is full the
+// producer waits for the writer rather than dropping records.
+class CdcStream {
+private:
+    std::string prefix;
+    std::vector<CdcRecord> ring;
+    std::atomic<uint64_t> head; // records published (producer)
+    std::atomic<uint64_t> tail; // records written (writer thread)
+    std::atomic<bool> stopping;
+    uint64_t next_sequence = 1; // producer only
+    std::thread writer;
+
+    // Writer thread state
+    std::fstream out;
+    uint64_t out_segment = 0;
+
+    // Opens the segment that holds 'sequence' at the position it goes to
+    bool seek_segment(uint64_t sequence) {
+        uint64_t segment = (sequence - 1) / kCdcSegmentRecords + 1;
+        uint64_t offset = (sequence - 1) % kCdcSegmentRecords;
+        if (segment != out_segment) {
+            out.close();
+            std::string path = cdc_segment_path(prefix, segment);
+            if (offset == 0) {
+                out.open(path.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+                if (!out) return false;
+                out.write("JCD1", 4);
+                uint32_t record_size = sizeof(CdcRecord);
+                out.write(reinterpret_cast<const char*>(&record_size), sizeof(record_size));
+                out.write(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+            } else {
+                out.open(path.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+                if (!out) return false;
+            }
+            out_segment = segment;
+        }
+        // Overwrites a torn record left by a crash, if any
+        out.seekp((std::streamoff)(kCdcHeaderBytes + offset * sizeof(CdcRecord)));
+        return (bool)out;
+    }
+
+    void drain() {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        if (t == h) return;
+        const size_t mask = ring.size() - 1;
+        for (; t != h; ++t) {
+            const CdcRecord& r = ring[t & mask];
+            if ((r.sequence - 1) % kCdcSegmentRecords == 0) seek_segment(r.sequence);
+            out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+            tail.store(t + 1, std::memory_order_release); // frees the ring entry
+        }
+        out.flush();
+    }
+
+    void run() {
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            drain();
+        }
+        drain();
+    }
+
+    // Sequence after the last complete record on disk (1 for a new stream)
+    uint64_t resume_sequence() const {
+        uint64_t segment = 1;
+        while (true) {
+            std::ifstream probe(cdc_segment_path(prefix, segment + 1).c_str(), std::ios::binary);
+            if (!probe) break;
+            ++segment;
+        }
+        std::ifstream in(cdc_segment_path(prefix, segment).c_str(), std::ios::binary | std::ios::ate);
+        if (!in) return 1;
+        std::streamoff size = in.tellg();
+        uint64_t records = size > (std::streamoff)kCdcHeaderBytes ? (uint64_t)(size - kCdcHeaderBytes) / sizeof(CdcRecord) : 0;
+        return (segment - 1) * kCdcSegmentRecords + std::min(records, kCdcSegmentRecords) + 1;
+    }
+
+public:
+    CdcStream() : head(0), tail(0), stopping(false) {}
+    ~CdcStream() { close(); }
+    CdcStream(const CdcStream&) = delete;
+    CdcStream& operator=(const CdcStream&) = delete;
+
+    // Continues the stream under 'path_prefix' (or starts it) and starts the writer
+    bool open(const std::string& path_prefix) {
+        prefix = path_prefix;
+        ring.assign(kCdcRingRecords, CdcRecord());
+        next_sequence = resume_sequence();
+        if (!seek_segment(next_sequence)) return false;
+        writer = std::thread(&CdcStream::run, this);
+        return true;
+    }
+
+    // Writes out everything published and stops the writer
+    void close() {
+        if (!writer.joinable()) return;
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        out.close();
+    }
+
+    bool is_open() const { return writer.joinable(); }
+
+    // Producer side (the manager's thread): no locks, no allocation
+    void publish(int32_t id, int64_t time_ms, uint8_t fields, ParcelState state, uint32_t weight_g, VersionOrigin origin) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) >= ring.size()) std::this_thread::yield(); // ring full
+        CdcRecord& r = ring[h & (ring.size() - 1)];
+        r = CdcRecord();
+        r.sequence = next_sequence++;
+        r.time_ms = time_ms;
+        r.id = id;
+        r.weight_g = weight_g;
+        r.fields = fields;
+        r.state = state;
+        r.origin = origin;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Blocks until every record published so far is on disk
+    void wait_written() const {
+        while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // Sequence number the next change will get
+    uint64_t next() const { return next_sequence; }
+    const std::string& path_prefix() const { return prefix; }
+};
+
+// A consumer's position in a CDC stream. poll() returns the complete records
+// after the cursor and moves past them; it only reads the segment files, so
+// any number of consumers (in this or another process) can tail the stream.
+class CdcCursor {
+private:
+    std::string prefix;
+    uint64_t next_sequence;
+
+public:
+    explicit CdcCursor(const std::string& path_prefix, uint64_t from = 1)
+        : prefix(path_prefix), next_sequence(from < 1 ? 1 : from) {}
+
+    // Appends up to 'max' records to 'out'; returns how many
+    size_t poll(std::vector<CdcRecord>& out, size_t max) {
+        size_t read = 0;
+        while (read < max) {
+            uint64_t segment = (next_sequence - 1) / kCdcSegmentRecords + 1;
+            uint64_t offset = (next_sequence - 1) % kCdcSegmentRecords;
+            std::ifstream in(cdc_segment_path(prefix, segment).c_str(), std::ios::binary);
+            char magic[4];
+            if (!in.read(magic, 4) || std::strncmp(magic, "JCD1", 4) != 0) break;
+            in.seekg((std::streamoff)(kCdcHeaderBytes + offset * sizeof(CdcRecord)));
+            CdcRecord r;
+            while (read < max && offset < kCdcSegmentRecords &&
+                   in.read(reinterpret_cast<char*>(&r), sizeof(r)) && r.sequence == next_sequence) {
+                out.push_back(r);
+                ++read;
+                ++offset;
+                ++next_sequence;
+            }
+            // Stop at the end of what has been written; carry on into the next segment
+            if (offset < kCdcSegmentRecords) break;
+        }
+        return read;
+    }
+
+    uint64_t position() const { return next_sequence; }
+};
+
+// What happened to a parcel, as announced on the event bus
+enum class EventType : uint8_t { Registered, WeightChanged, Loaded, Dispatched, Delivered, Cancelled, Removed, Archived };
+const int kEventTypeCount = 8;
+const uint16_t kAllEvents = (1u << kEventTypeCount) - 1;
+
+inline const char* event_name(EventType type) {
+    switch (type) {
+        case EventType::Registered: return "registered";
+        case EventType::WeightChanged: return "weight changed";
+        case EventType::Loaded: return "loaded";
+        case EventType::Dispatched: return "dispatched";
+        case EventType::Delivered: return "delivered";
+        case EventType::Cancelled: return "cancelled";
+        case EventType::Removed: return "removed";
+        case EventType::Archived: return "archived";
+    }
+    return "?";
+}
+
+inline uint16_t event_bit(EventType type) { return (uint16_t)(1u << (int)type); }
+
+// The event for a parcel version: a state change names the state entered
+inline EventType event_type(uint8_t fields, ParcelState state, VersionOrigin origin) {
+    if (!(fields & kVersionState)) return EventType::WeightChanged;
+    switch (state) {
+        case ParcelState::Free: return origin == VersionOrigin::Archive ? EventType::Archived : EventType::Removed;
+        case ParcelState::Registered: return EventType::Registered;
+        case ParcelState::Loaded: return EventType::Loaded;
+        case ParcelState::Dispatched: return EventType::Dispatched;
+        case ParcelState::Delivered: return EventType::Delivered;
+        case ParcelState::Cancelled: return EventType::Cancelled;
+    }
+    return EventType::Removed;
+}
+
+struct ParcelEvent {
+    int64_t time_ms;   // wall clock, ms since the epoch
+    int32_t id;
+    uint32_t weight_g; // new weight (Registered and WeightChanged events; 0 otherwise)
+    EventType type;
+    VersionOrigin origin; // an operation, or its undo, redo or log replay
+};
+
+// What a subscriber's full queue does to the operation publishing into it
+enum class Backpressure : uint8_t {
+    Drop, // the event is dropped for this subscriber (and counted); operations never wait
+    Block // the operation waits for the subscriber: for consumers that must see every event
+};
+
+// One subscriber: a bounded single-producer/single-consumer queue filled by
+// the manager's thread and drained by the subscriber's own thread, which
+// calls the handler. Only 'types' events are queued.
+class EventSubscriber {
+private:
+    friend class EventBus;
+
+    std::string name;
+    uint16_t types;
+    Backpressure policy;
+    std::function<void(const ParcelEvent&)> handler;
+    std::vector<ParcelEvent> ring;
+    std::atomic<uint64_t> head;    // events queued (producer)
+    std::atomic<uint64_t> tail;    // events handled (subscriber thread)
+    std::atomic<uint64_t> dropped; // events lost to a full queue
+    std::atomic<bool> stopping;
+    std::thread worker;
+
+    void run() {
+        const size_t mask = ring.size() - 1;
+        while (true) {
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire)) {
+                if (stopping.load(std::memory_order_acquire)) return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            handler(ring[t & mask]);
+            tail.store(t + 1, std::memory_order_release);
+        }
+    }
+
+    // Producer side: no locks, no allocation
+    void offer(const ParcelEvent& e) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) >= ring.size()) {
+            if (policy == Backpressure::Drop) { dropped.fetch_add(1, std::memory_order_relaxed); return; }
+            std::this_thread::yield();
+        }
+        ring[h & (ring.size() - 1)] = e;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+public:
+    // 'capacity' is rounded up to a power of two
+    EventSubscriber(const std::string& subscriber_name, uint16_t event_types, Backpressure backpressure,
+                    size_t capacity, const std::function<void(const ParcelEvent&)>& on_event)
+        : name(subscriber_name), types(event_types), policy(backpressure), handler(on_event),
+          head(0), tail(0), dropped(0), stopping(false) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        ring.resize(size);
+        worker = std::thread(&EventSubscriber::run, this);
+    }
+    ~EventSubscriber() { stop(); }
+    EventSubscriber(const EventSubscriber&) = delete;
+    EventSubscriber& operator=(const EventSubscriber&) = delete;
+
+    // Handles what is queued, then stops the subscriber's thread
+    void stop() {
+        if (!worker.joinable()) return;
+        stopping.store(true, std::memory_order_release);
+        worker.join();
+    }
+
+    const std::string& subscriber_name() const { return name; }
+    Backpressure backpressure() const { return policy; }
+    size_t capacity() const { return ring.size(); }
+    uint64_t handled() const { return tail.load(std::memory_order_acquire); }
+    uint64_t queued() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    uint64_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+// Fans parcel events out to every subscriber whose filter takes them. Each
+// subscriber has its own queue and thread, so a slow one only ever fills its
+// own queue: with Drop it loses events, and only Block makes operations wait.
+// Subscribing happens on the manager's thread, between operations.
+class EventBus {
+private:
+    std::deque<EventSubscriber> subscribers; // never moved: their threads point at them
+
+public:
+    EventSubscriber& subscribe(const std::string& name, uint16_t types, Backpressure policy, size_t capacity,
+                               const std::function<void(const ParcelEvent&)>& handler) {
+        subscribers.emplace_back(name, types, policy, capacity, handler);
+        return subscribers.back();
+    }
+
+    void emit(const ParcelEvent& e) {
+        uint16_t bit = event_bit(e.type);
+        for (EventSubscriber& s : subscribers) {
+            if (s.types & bit) s.offer(e);
+        }
+    }
+
+    bool empty() const { return subscribers.empty(); }
+    size_t size() const { return subscribers.size(); }
+    const EventSubscriber& at(size_t i) const { return subscribers[i]; }
+};
+
+// State of the built-in metrics plugin: events handled per type. Shared with
+// the plugin's handler, which runs on the subscriber's thread.
+struct EventMetrics {
+    std::atomic<uint64_t> counts[kEventTypeCount];
+    EventMetrics() {
+        for (std::atomic<uint64_t>& c : counts) c.store(0);
+    }
+};
+
+// Replication from a primary manager to hot standbys over a local (Unix
+// domain) socket. The primary streams every parcel change it records; each
+// replica applies them to its own store as they arrive, so promoting one to
+// primary needs no reload.
+enum class ReplicaOp : uint8_t { Hello, Add, Text, Transition, Weight, Remove, Heartbeat };
+
+// One replication record, sent as raw bytes (both ends run the same build on one host)
+struct ReplicationRecord {
+    uint64_t sequence; // the change's number on the primary (Hello, Heartbeat: newest change published)
+    int64_t time_ms;   // when the primary made the change (Heartbeat: when sent)
+    uint32_t slot;     // the primary's store slot
+    int32_t id;
+    uint32_t weight_g;
+    ReplicaOp op;
+    ParcelState state;
+    VersionOrigin origin;
+    uint8_t spare;
+    unsigned char payload[96]; // Add: the Parcel; Text: a ReplicaText; Hello: a ReplicaHello
+};
+static_assert(std::is_trivially_copyable<ReplicationRecord>::value, "Replication records are sent as raw bytes");
+static_assert(sizeof(ReplicationRecord) == 128, "Replication records must not contain padding");
+static_assert(sizeof(Parcel) <= sizeof(ReplicationRecord().payload), "A Parcel must fit a replication record");
+
+// Part of a pooled (long) text value; sent before the Add that refers to it
+struct ReplicaText {
+    uint32_t pool_index; // in the primary's string pool
+    uint32_t length;
+    uint32_t offset;
+    char bytes[84];
+};
+static_assert(sizeof(ReplicaText) == 96, "Text chunks fill the record payload");
+
+// First record on a new connection: the primary's id settings
+struct ReplicaHello {
+    uint8_t auto_ids;
+    uint8_t spare[3];
+    int32_t shard;
+};
+
+// Records the primary's operations can run ahead of the sender thread (a power of two)
+const size_t kReplicationRingRecords = 8192;
+// How often the primary tells idle replicas how far it has got
+const int kHeartbeatIntervalMs = 100;
+
+inline int64_t wall_clock_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Primary side. Operations copy their changes into a single-producer ring; a
+// sender thread accepts replicas, drains the ring to every connected one and
+// sends heartbeats. The sender keeps a mirror of the parcels from the records
+// it has drained, so a replica that connects late gets a consistent snapshot
+// followed by the live stream, without involving the operation path. A replica
+// that stops reading for a second is disconnected rather than stalling the
+// primary.
+class ReplicationSource {
+private:
+    struct MirrorEntry {
+        Parcel parcel;
+        ParcelState state;
+    };
+
+    std::string path;
+    ReplicaHello hello = ReplicaHello();
+    std::vector<ReplicationRecord> ring;
+    std::atomic<uint64_t> head; // records published (producer)
+    std::atomic<uint64_t> tail; // records sent (sender thread)
+    std::atomic<size_t> replicas;
+    std::atomic<bool> stopping;
+    uint64_t next_sequence = 1; // producer only
+    std::thread sender;
+
+    // Sender thread state
+    int listen_fd = -1;
+    std::vector<int> connections;
+    std::vector<MirrorEntry> mirror;                  // by the primary's slot (state Free: empty)
+    std::unordered_map<uint32_t, std::string> texts;  // pooled text by the primary's pool index
+
+    void push(ReplicationRecord& r) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) >= ring.size()) std::this_thread::yield(); // ring full
+        r.sequence = next_sequence++;
+        ring[h & (ring.size() - 1)] = r;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Fills r with each chunk of a pooled text value in turn, calling sink(r)
+    template <typename Sink>
+    static void for_each_text_chunk(uint32_t pool_index, const std::string& value, ReplicationRecord& r, Sink sink) {
+        r.op = ReplicaOp::Text;
+        ReplicaText text = ReplicaText();
+        text.pool_index = pool_index;
+        text.length = (uint32_t)value.size();
+        for (size_t offset = 0; offset < value.size(); offset += sizeof(text.bytes)) {
+            text.offset = (uint32_t)offset;
+            std::memcpy(text.bytes, value.data() + offset, std::min(sizeof(text.bytes), value.size() - offset));
+            std::memcpy(r.payload, &text, sizeof(text));
+            sink(r);
+        }
+    }
+
+    // Pooled fields are sent ahead of the parcel
+    void push_text(const InlineString& s, ReplicationRecord& r) {
+        if (!s.pooled()) return;
+        for_each_text_chunk(s.pool_index(), string_pool().get(s.pool_index()), r, [&](ReplicationRecord& chunk) { push(chunk); });
+    }
+
+    void mirror_apply(const ReplicationRecord& r) {
+        if (r.op == ReplicaOp::Text) {
+            ReplicaText text;
+            std::memcpy(&text, r.payload, sizeof(text));
+            std::string& value = texts[text.pool_index];
+            value.resize(text.length);
+            std::memcpy(&value[0] + text.offset, text.bytes, std::min<size_t>(sizeof(text.bytes), text.length - text.offset));
+            return;
+        }
+        if (r.slot >= mirror.size()) mirror.resize(r.slot + 1, MirrorEntry{Parcel(), ParcelState::Free});
+        MirrorEntry& m = mirror[r.slot];
+        switch (r.op) {
+            case ReplicaOp::Add:
+                std::memcpy(&m.parcel, r.payload, sizeof(Parcel));
+                m.state = ParcelState::Registered;
+                break;
+            case ReplicaOp::Transition: m.state = r.state; break;
+            case ReplicaOp::Weight: m.parcel.weight = Weight::from_grams(r.weight_g); break;
+            case ReplicaOp::Remove: m.state = ParcelState::Free; break;
+            default: break;
+        }
+    }
+
+    static bool send_all(int fd, const void* data, size_t bytes) {
+#if defined(__linux__)
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t sent = ::send(fd, p, bytes, MSG_NOSIGNAL);
+            if (sent <= 0) return false;
+            p += sent;
+            bytes -= (size_t)sent;
+        }
+        return true;
+#else
+        (void)fd; (void)data; (void)bytes;
+        return false;
+#endif
+    }
+
+    void send_to_all(const ReplicationRecord* records, size_t count) {
+        for (size_t i = 0; i < connections.size();) {
+            if (send_all(connections[i], records, count * sizeof(ReplicationRecord))) { ++i; continue; }
+#if defined(__linux__)
+            ::close(connections[i]);
+#endif
+            connections.erase(connections.begin() + i);
+            replicas.store(connections.size(), std::memory_order_relaxed);
+        }
+    }
+
+    // Hello, the pooled texts, then every parcel the primary holds as of the records drained so far
+    bool send_snapshot(int fd, uint64_t position) {
+        std::vector<ReplicationRecord> batch;
+        ReplicationRecord r = ReplicationRecord();
+        r.sequence = position;
+        r.time_ms = wall_clock_ms();
+        r.op = ReplicaOp::Hello;
+        std::memcpy(r.payload, &hello, sizeof(hello));
+        batch.push_back(r);
+        for (const auto& entry : texts) {
+            for_each_text_chunk(entry.first, entry.second, r, [&](ReplicationRecord& chunk) { batch.push_back(chunk); });
+        }
+        for (uint32_t slot = 0; slot < mirror.size(); ++slot) {
+            const MirrorEntry& m = mirror[slot];
+            if (m.state == ParcelState::Free) continue;
+            r.slot = slot;
+            r.id = m.parcel.id;
+            r.op = ReplicaOp::Add;
+            r.weight_g = (uint32_t)m.parcel.weight.grams();
+            std::memcpy(r.payload, &m.parcel, sizeof(Parcel));
+            batch.push_back(r);
+            if (m.state == ParcelState::Registered) continue;
+            r.op = ReplicaOp::Transition;
+            r.state = m.state;
+            batch.push_back(r);
+            r.state = ParcelState::Free;
+        }
+        return send_all(fd, batch.data(), batch.size() * sizeof(ReplicationRecord));
+    }
+
+    void accept_replicas(uint64_t position) {
+#if defined(__linux__)
+        while (true) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) return;
+            timeval timeout = { 1, 0 }; // a replica that stops reading is dropped after a second
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (!send_snapshot(fd, position)) { ::close(fd); continue; }
+            connections.push_back(fd);
+            replicas.store(connections.size(), std::memory_order_relaxed);
+        }
+#else
+        (void)position;
+#endif
+    }
+
+    void run() {
+        std::vector<ReplicationRecord> batch;
+        std::chrono::steady_clock::time_point last_beat = std::chrono::steady_clock::now();
+        const size_t mask = ring.size() - 1;
+        while (true) {
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            accept_replicas(t);
+            uint64_t h = head.load(std::memory_order_acquire);
+            batch.clear();
+            for (; t != h; ++t) {
+                batch.push_back(ring[t & mask]);
+                mirror_apply(batch.back());
+            }
+            tail.store(h, std::memory_order_release); // frees the ring entries
+            if (!batch.empty()) send_to_all(batch.data(), batch.size());
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now - last_beat >= std::chrono::milliseconds(kHeartbeatIntervalMs)) {
+                ReplicationRecord beat = ReplicationRecord();
+                beat.sequence = head.load(std::memory_order_acquire);
+                beat.time_ms = wall_clock_ms();
+                beat.op = ReplicaOp::Heartbeat;
+                send_to_all(&beat, 1);
+                last_beat = now;
+            }
+            if (batch.empty()) {
+                if (stopping.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == h) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+#if defined(__linux__)
+        for (int fd : connections) ::close(fd);
+#endif
+        connections.clear();
+        replicas.store(0, std::memory_order_relaxed);
+    }
+
+public:
+    ReplicationSource() : head(0), tail(0), replicas(0), stopping(false) {}
+    ~ReplicationSource() { close(); }
+    ReplicationSource(const ReplicationSource&) = delete;
+    ReplicationSource& operator=(const ReplicationSource&) = delete;
+
+    // Listens on 'socket_path' and starts the sender. False on non-POSIX builds.
+    bool open(const std::string& socket_path, bool auto_ids, int shard) {
+#if defined(__linux__)
+        sockaddr_un address = sockaddr_un();
+        if (socket_path.size() >= sizeof(address.sun_path)) return false;
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listen_fd < 0) return false;
+        ::unlink(socket_path.c_str()); // left behind by an earlier primary
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 8) != 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        path = socket_path;
+        hello.auto_ids = auto_ids ? 1 : 0;
+        hello.shard = shard;
+        ring.assign(kReplicationRingRecords, ReplicationRecord());
+        stopping.store(false);
+        sender = std::thread(&ReplicationSource::run, this);
+        return true;
+#else
+        (void)socket_path; (void)auto_ids; (void)shard;
+        return false;
+#endif
+    }
+
+    // Sends everything published, then disconnects the replicas
+    void close() {
+        if (!sender.joinable()) return;
+        stopping.store(true, std::memory_order_release);
+        sender.join();
+#if defined(__linux__)
+        ::close(listen_fd);
+        ::unlink(path.c_str());
+#endif
+        listen_fd = -1;
+    }
+
+    bool is_open() const { return sender.joinable(); }
+
+    // Producer side (the manager's thread): no locks, no allocation. 'added' is
+    // the parcel when this change is its registration.
+    void publish(uint32_t slot, int32_t id, uint8_t fields, ParcelState state, uint32_t weight_g,
+                 VersionOrigin origin, int64_t time_ms, const Parcel* added) {
+        ReplicationRecord r = ReplicationRecord();
+        r.time_ms = time_ms;
+        r.slot = slot;
+        r.id = id;
+        r.weight_g = weight_g;
+        r.state = state;
+        r.origin = origin;
+        if (added) {
+            push_text(added->sender, r);
+            push_text(added->recipient, r);
+            push_text(added->address, r);
+            r.op = ReplicaOp::Add;
+            std::memcpy(r.payload, added, sizeof(Parcel));
+        } else {
+            r.op = !(fields & kVersionState) ? ReplicaOp::Weight
+                 : state == ParcelState::Free ? ReplicaOp::Remove : ReplicaOp::Transition;
+        }
+        push(r);
+    }
+
+    uint64_t published() const { return next_sequence - 1; }
+    size_t replica_count() const { return replicas.load(std::memory_order_relaxed); }
+    const std::string& socket_path() const { return path; }
+};
+
+// Replica side: a receiver thread reads the primary's records and hands each
+// batch to 'apply', which returns false to stop (e.g. mismatched id settings).
+// Lag is measured against the primary's heartbeats.
+class ReplicaLink {
+private:
+    std::string path;
+    int fd = -1;
+    std::function<bool(const ReplicationRecord*, size_t)> apply;
+    std::atomic<bool> stopping;
+    std::atomic<bool> connected;
+    std::atomic<uint64_t> applied;         // newest change applied
+    std::atomic<uint64_t> primary;         // newest change published by the primary, as of its last heartbeat
+    std::atomic<int64_t> applied_time_ms;  // when the primary made the newest applied change
+    std::atomic<int64_t> heartbeat_ms;     // local time the last heartbeat arrived
+    std::thread receiver;
+
+    void run() {
+#if defined(__linux__)
+        std::vector<ReplicationRecord> buffer(512);
+        size_t have = 0; // bytes in 'buffer'
+        const size_t capacity = buffer.size() * sizeof(ReplicationRecord);
+        while (!stopping.load(std::memory_order_acquire)) {
+            pollfd p = { fd, POLLIN, 0 };
+            if (::poll(&p, 1, 50) <= 0) continue;
+            ssize_t n = ::recv(fd, reinterpret_cast<char*>(buffer.data()) + have, capacity - have, 0);
+            if (n <= 0) break; // the primary went away
+            have += (size_t)n;
+            size_t count = have / sizeof(ReplicationRecord);
+            if (count == 0) continue;
+            if (!apply(buffer.data(), count)) break;
+            for (size_t i = 0; i < count; ++i) {
+                const ReplicationRecord& r = buffer[i];
+                if (r.op == ReplicaOp::Heartbeat) {
+                    primary.store(r.sequence, std::memory_order_relaxed);
+                    heartbeat_ms.store(wall_clock_ms(), std::memory_order_relaxed);
+                } else {
+                    applied.store(r.sequence, std::memory_order_relaxed);
+                    if (r.op != ReplicaOp::Hello) applied_time_ms.store(r.time_ms, std::memory_order_relaxed);
+                    if (r.sequence > primary.load(std::memory_order_relaxed)) primary.store(r.sequence, std::memory_order_relaxed);
+                }
+            }
+            size_t used = count * sizeof(ReplicationRecord);
+            std::memmove(buffer.data(), reinterpret_cast<char*>(buffer.data()) + used, have - used);
+            have -= used;
+        }
+        connected.store(false, std::memory_order_release);
+#endif
+    }
+
+public:
+    ReplicaLink() : stopping(false), connected(false), applied(0), primary(0), applied_time_ms(0), heartbeat_ms(0) {}
+    ~ReplicaLink() { close(); }
+    ReplicaLink(const ReplicaLink&) = delete;
+    ReplicaLink& operator=(const ReplicaLink&) = delete;
+
+    // Connects to the primary listening on 'socket_path'. False on non-POSIX builds.
+    bool open(const std::string& socket_path, const std::function<bool(const ReplicationRecord*, size_t)>& on_records) {
+        path = socket_path;
+#if defined(__linux__)
+        sockaddr_un address = sockaddr_un();
+        if (socket_path.size() >= sizeof(address.sun_path)) return false;
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        apply = on_records;
+        connected.store(true);
+        receiver = std::thread(&ReplicaLink::run, this);
+        return true;
+#else
+        (void)on_records;
+        return false;
+#endif
+    }
+
+    // Stops applying and disconnects (promotion, or shutdown)
+    void close() {
+        if (!receiver.joinable()) return;
+        stopping.store(true, std::memory_order_release);
+        receiver.join();
+#if defined(__linux__)
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    bool is_connected() const { return connected.load(std::memory_order_acquire); }
+    const std::string& socket_path() const { return path; }
+    uint64_t applied_sequence() const { return applied.load(std::memory_order_relaxed); }
+    uint64_t primary_sequence() const { return primary.load(std::memory_order_relaxed); }
+    int64_t applied_change_ms() const { return applied_time_ms.load(std::memory_order_relaxed); }
+    int64_t last_heartbeat_ms() const { return heartbeat_ms.load(std::memory_order_relaxed); }
+};
+
+// Read-only shared-memory view for dashboards in other processes: the hot
+// parcel columns, indexed by store slot, plus per-state aggregates, versioned
+// with a seqlock. The manager bumps the sequence to odd, writes, and bumps it
+// back to even; a reader copies what it needs and retries if the sequence was
+// odd or moved meanwhile. Readers never block the manager and need no IPC.
+// Region layout: SharedViewHeader, padded to 64 bytes, then the columns
+// ids (i32), weight_g (u32), state (u8) and priority (u8), 'capacity' rows each.
+struct SharedViewHeader {
+    char magic[8];                  // "JUMIAVW1"
+    uint32_t capacity;              // rows in each column
+    uint32_t header_bytes;          // offset of the first column
+    std::atomic<uint64_t> sequence; // seqlock: odd while the manager is writing
+    // Written only inside a write section
+    uint64_t changes;               // parcel changes applied
+    int64_t updated_ms;             // time of the newest change
+    uint32_t rows;                  // slots in use are below this
+    uint32_t overflow;              // parcels in slots past 'capacity' (counted, no row)
+    uint64_t counts[kStateCount];   // parcels per state; index 0 (Free): archived parcels
+    uint64_t weights_g[kStateCount];
+};
+
+// One consistent copy of the view, as a reader gets it
+struct SharedViewSnapshot {
+    uint64_t sequence;
+    uint64_t changes;
+    int64_t updated_ms;
+    uint32_t rows;
+    uint32_t overflow;
+    uint64_t counts[kStateCount];
+    uint64_t weights_g[kStateCount];
+    std::vector<int32_t> ids;
+    std::vector<uint32_t> weights;
+    std::vector<uint8_t> states;     // ParcelState; Free: empty row
+    std::vector<uint8_t> priorities;
+};
+
+// Rows the view holds when --reserve does not ask for more
+const uint32_t kSharedViewMinRows = 1u << 20;
+
+class SharedView {
+private:
+    std::string name;
+    SharedViewHeader* header = nullptr;
+    size_t bytes = 0;
+    bool writer = false;
+    int32_t* ids = nullptr;
+    uint32_t* weights = nullptr;
+    uint8_t* states = nullptr;
+    uint8_t* priorities = nullptr;
+    // Manager side: state and weight of parcels in slots past the columns, so the aggregates stay exact
+    std::vector<std::pair<ParcelState, uint32_t> > spill;
+
+    static size_t region_bytes(uint32_t capacity) {
+        size_t header_bytes = (sizeof(SharedViewHeader) + 63) & ~(size_t)63;
+        return header_bytes + (size_t)capacity * (sizeof(int32_t) + sizeof(uint32_t) + 2);
+    }
+
+    void map_columns() {
+        char* base = reinterpret_cast<char*>(header) + header->header_bytes;
+        ids = reinterpret_cast<int32_t*>(base);
+        weights = reinterpret_cast<uint32_t*>(base + header->capacity * sizeof(int32_t));
+        states = reinterpret_cast<uint8_t*>(base + header->capacity * (sizeof(int32_t) + sizeof(uint32_t)));
+        priorities = states + header->capacity;
+    }
+
+    static std::string shm_name(const std::string& n) { return n.empty() || n[0] == '/' ? n : "/" + n; }
+
+    ParcelState row_state(uint32_t slot) const {
+        return slot < header->capacity ? (ParcelState)states[slot] : spill[slot - header->capacity].first;
+    }
+    uint32_t row_weight(uint32_t slot) const {
+        return slot < header->capacity ? weights[slot] : spill[slot - header->capacity].second;
+    }
+    void set_row(uint32_t slot, ParcelState state, uint32_t weight_g) {
+        if (slot < header->capacity) {
+            states[slot] = (uint8_t)state;
+            weights[slot] = weight_g;
+            return;
+        }
+        if (slot - header->capacity >= spill.size()) spill.resize(slot - header->capacity + 1);
+        spill[slot - header->capacity] = std::make_pair(state, weight_g);
+    }
+
+public:
+    SharedView() {}
+    ~SharedView() { close(); }
+    SharedView(const SharedView&) = delete;
+    SharedView& operator=(const SharedView&) = delete;
+
+    // Manager side: creates (or replaces) the region. False on non-POSIX builds.
+    bool create(const std::string& region, uint32_t capacity) {
+#if defined(__linux__)
+        name = shm_name(region);
+        bytes = region_bytes(capacity);
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        void* p = ::ftruncate(fd, (off_t)bytes) == 0 ? ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) { ::shm_unlink(name.c_str()); return false; }
+        header = static_cast<SharedViewHeader*>(p); // fresh pages are zero: every row empty, every count 0
+        header->capacity = capacity;
+        header->header_bytes = (uint32_t)((sizeof(SharedViewHeader) + 63) & ~(size_t)63);
+        header->sequence.store(0, std::memory_order_relaxed);
+        map_columns();
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, "JUMIAVW1", 8); // last, so readers never see a half-built header
+        writer = true;
+        return true;
+#else
+        (void)region; (void)capacity;
+        return false;
+#endif
+    }
+
+    // Reader side: maps a region the manager created, read-only
+    bool open(const std::string& region) {
+#if defined(__linux__)
+        name = shm_name(region);
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat info;
+        void* p = MAP_FAILED;
+        if (::fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedViewHeader)) {
+            bytes = (size_t)info.st_size;
+            p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        header = static_cast<SharedViewHeader*>(p);
+        if (std::memcmp(header->magic, "JUMIAVW1", 8) != 0 || region_bytes(header->capacity) > bytes) {
+            close();
+            return false;
+        }
+        map_columns();
+        return true;
+#else
+        (void)region;
+        return false;
+#endif
+    }
+
+    // Unmaps; the manager also removes the region's name
+    void close() {
+#if defined(__linux__)
+        if (!header) return;
+        ::munmap(header, bytes);
+        if (writer) ::shm_unlink(name.c_str());
+#endif
+        header = nullptr;
+        writer = false;
+    }
+
+    bool is_open() const { return header != nullptr; }
+    const std::string& region_name() const { return name; }
+    uint32_t capacity() const { return header ? header->capacity : 0; }
+
+    // Manager side: one parcel change, in its own write section. 'added' is the
+    // whole parcel when this is its registration.
+    void apply(uint32_t slot, int32_t id, uint8_t fields, ParcelState state, uint32_t weight_g,
+               VersionOrigin origin, int64_t time_ms, const Parcel* added) {
+        uint64_t seq = header->sequence.load(std::memory_order_relaxed);
+        header->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (added) {
+            if (slot < header->capacity) {
+                ids[slot] = id;
+                priorities[slot] = (uint8_t)added->priority;
+                if (slot >= header->rows) header->rows = slot + 1;
+            } else {
+                ++header->overflow;
+            }
+            set_row(slot, ParcelState::Registered, weight_g);
+            ++header->counts[(int)ParcelState::Registered];
+            header->weights_g[(int)ParcelState::Registered] += weight_g;
+        } else if (!(fields & kVersionState)) {
+            int s = (int)row_state(slot);
+            header->weights_g[s] = header->weights_g[s] - row_weight(slot) + weight_g;
+            set_row(slot, row_state(slot), weight_g);
+        } else {
+            int s = (int)row_state(slot);
+            uint32_t w = row_weight(slot);
+            --header->counts[s];
+            header->weights_g[s] -= w;
+            if (state != ParcelState::Free || origin == VersionOrigin::Archive) {
+                ++header->counts[(int)state]; // Free: archived
+                header->weights_g[(int)state] += w;
+            }
+            if (state == ParcelState::Free && slot >= header->capacity) --header->overflow;
+            set_row(slot, state, w);
+        }
+        ++header->changes;
+        header->updated_ms = time_ms;
+
+        header->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Manager side: adds parcels archived by earlier runs to the archived aggregates
+    void add_archived(uint64_t parcels, uint64_t weight_g) {
+        uint64_t seq = header->sequence.load(std::memory_order_relaxed);
+        header->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->counts[(int)ParcelState::Free] += parcels;
+        header->weights_g[(int)ParcelState::Free] += weight_g;
+        header->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Reader side: a consistent copy, retrying while the manager writes. False
+    // if no attempt of 'max_attempts' saw a quiet moment.
+    bool read(SharedViewSnapshot& out, int max_attempts) const {
+        for (int attempt = 0; attempt < max_attempts; ++attempt) {
+            uint64_t before = header->sequence.load(std::memory_order_acquire);
+            if (before & 1) { std::this_thread::yield(); continue; }
+            out.sequence = before;
+            out.changes = header->changes;
+            out.updated_ms = header->updated_ms;
+            out.rows = std::min(header->rows, header->capacity);
+            out.overflow = header->overflow;
+            std::memcpy(out.counts, header->counts, sizeof(out.counts));
+            std::memcpy(out.weights_g, header->weights_g, sizeof(out.weights_g));
+            out.ids.assign(ids, ids + out.rows);
+            out.weights.assign(weights, weights + out.rows);
+            out.states.assign(states, states + out.rows);
+            out.priorities.assign(priorities, priorities + out.rows);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->sequence.load(std::memory_order_relaxed) == before) return true;
+        }
+        return false;
+    }
+};
+
+// Append-only history of every parcel, fed by ParcelStore on each change.
+// Versions are carved from their own arena and never move or die, so chains
+// are plain pointers. The newest version is found per slot while the parcel
+// is held in the store, and per id once it has left (archived, or its
+// registration undone), so a later re-registration continues the same chain.
+// The journal lists every version in the order written, for point-in-time
+// replay from the nearest snapshot; it is kept in a change stream of its own
+// next to the archive, and restore() reads earlier runs back at start-up
+// (snapshots are cut from the journal, so they are simply cut again). Every
+// version is also published to the change stream, announced on the event bus,
+// streamed to replicas and written to the shared-memory view, when those are
+// attached.
+class ParcelHistory {
+private:
+    struct JournalEntry {
+        const ParcelVersion* version;
+        int32_t id;
+    };
+
+    Arena arena;
+    std::vector<const ParcelVersion*, ArenaAllocator<const ParcelVersion*> > slot_head;
+    std::unordered_map<int, const ParcelVersion*> departed;
+    std::vector<JournalEntry, ArenaAllocator<JournalEntry> > journal;
+    VersionOrigin origin = VersionOrigin::Operation;
+    CdcStream* cdc = nullptr;
+    CdcStream* journal_file = nullptr;
+    EventBus* events = nullptr;
+    ReplicationSource* replication = nullptr;
+    SharedView* view = nullptr;
+
+    // Replay snapshots, oldest first, and the running image they are cut from
+    std::vector<ReplaySnapshot> snapshots;
+    std::unordered_map<int, ParcelImage> folded;
+    size_t folded_position = 0;
+
+    static void apply(std::unordered_map<int, ParcelImage>& images, const JournalEntry& e) {
+        const ParcelVersion& v = *e.version;
+        bool gone = (v.fields & kVersionState) && v.state == ParcelState::Free;
+        if (gone && v.origin != VersionOrigin::Archive) { images.erase(e.id); return; } // registration undone
+        ParcelImage& image = images[e.id];
+        image.id = e.id;
+        if (v.fields & kVersionWeight) image.weight_g = v.weight_g;
+        if (v.fields & kVersionState) image.state = v.state;
+    }
+
+    static void sorted_images(const std::unordered_map<int, ParcelImage>& images, std::vector<ParcelImage>& out) {
+        out.clear();
+        out.reserve(images.size());
+        for (const auto& entry : images) out.push_back(entry.second);
+        std::sort(out.begin(), out.end(), [](const ParcelImage& a, const ParcelImage& b) { return a.id < b.id; });
+    }
+
+public:
+    explicit ParcelHistory(Arena* storage = nullptr)
+        : arena(1 << 20), slot_head(ArenaAllocator<const ParcelVersion*>(storage)),
+          journal(ArenaAllocator<JournalEntry>(storage)) {}
+    ParcelHistory(const ParcelHistory&) = delete;
+    ParcelHistory& operator=(const ParcelHistory&) = delete;
+
+    // Room for 'parcels' slots and 'count' versions without allocating
+    void reserve(size_t parcels, size_t count) {
+        slot_head.reserve(parcels);
+        arena.reserve(count * sizeof(ParcelVersion));
+        journal.reserve(count);
+    }
+
+    // Tags the versions written until the next call
+    void set_origin(VersionOrigin o) { origin = o; }
+
+    void attach_cdc(CdcStream* stream) { cdc = stream; }
+    void attach_journal_file(CdcStream* stream) { journal_file = stream; }
+    void attach_events(EventBus* bus) { events = bus; }
+    void attach_replication(ReplicationSource* source) { replication = source; }
+    void attach_view(SharedView* shared) { view = shared; }
+
+    // A parcel enters 'slot': pick up its earlier chain if the id was held before
+    void attach(uint32_t slot, int id) {
+        if (slot >= slot_head.size()) slot_head.resize(slot + 1, nullptr);
+        slot_head[slot] = nullptr;
+        if (departed.empty()) return;
+        auto it = departed.find(id);
+        if (it == departed.end()) return;
+        slot_head[slot] = it->second;
+        departed.erase(it);
+    }
+
+    // The parcel leaves 'slot': its chain is kept under its id
+    void detach(uint32_t slot, int id) {
+        departed[id] = slot_head[slot];
+        slot_head[slot] = nullptr;
+    }
+
+    // 'added' is the whole parcel when this version is its registration
+    void append(uint32_t slot, int id, uint8_t fields, ParcelState state, uint32_t weight_g, const Parcel* added = nullptr) {
+        int64_t time_ms = wall_clock_ms();
+        if (journal_file) journal_file->publish(id, time_ms, fields, state, weight_g, origin);
+        if (cdc) cdc->publish(id, time_ms, fields, state, weight_g, origin);
+        if (replication) replication->publish(slot, id, fields, state, weight_g, origin, time_ms, added);
+        if (view) view->apply(slot, id, fields, state, weight_g, origin, time_ms, added);
+        if (events && !events->empty()) {
+            ParcelEvent e = { time_ms, id, (fields & kVersionWeight) ? weight_g : 0, event_type(fields, state, origin), origin };
+            events->emit(e);
+        }
+        ParcelVersion* v = static_cast<ParcelVersion*>(arena.allocate(sizeof(ParcelVersion), alignof(ParcelVersion)));
+        if (!v) return; // out of memory: the history has a gap, the operation still goes ahead
+        v->prev = slot_head[slot];
+        v->time_ms = time_ms;
+        v->origin = origin;
+        v->fields = fields;
+        v->state = state;
+        v->spare = 0;
+        v->weight_g = weight_g;
+        slot_head[slot] = v;
+        JournalEntry e = { v, id };
+        journal.push_back(e);
+    }
+
+    // Start-up: re-appends a version written by an earlier run. No parcel is
+    // held yet, so it extends the chain kept under its id.
+    void restore(const CdcRecord& r) {
+        ParcelVersion* v = static_cast<ParcelVersion*>(arena.allocate(sizeof(ParcelVersion), alignof(ParcelVersion)));
+        if (!v) return;
+        const ParcelVersion*& head = departed[r.id];
+        v->prev = head;
+        v->time_ms = r.time_ms;
+        v->origin = r.origin;
+        v->fields = r.fields;
+        v->state = r.state;
+        v->spare = 0;
+        v->weight_g = r.weight_g;
+        head = v;
+        JournalEntry e = { v, r.id };
+        journal.push_back(e);
+    }
+
+    // Start-up, after restore(): only the archive outlives a run, so every
+    // parcel the last run still held is gone. Closes each such chain with a
+    // removal at 'time_ms' (also written to the journal file). Returns how many.
+    size_t close_lost(int64_t time_ms) {
+        size_t closed = 0;
+        for (auto& entry : departed) {
+            const ParcelVersion* v = entry.second;
+            while (v && !(v->fields & kVersionState)) v = v->prev;
+            if (!v || v->state == ParcelState::Free) continue;
+            ParcelVersion* gone = static_cast<ParcelVersion*>(arena.allocate(sizeof(ParcelVersion), alignof(ParcelVersion)));
+            if (!gone) break;
+            gone->prev = entry.second;
+            gone->time_ms = time_ms;
+            gone->origin = VersionOrigin::Restart;
+            gone->fields = kVersionState;
+            gone->state = ParcelState::Free;
+            gone->spare = 0;
+            gone->weight_g = 0;
+            entry.second = gone;
+            JournalEntry e = { gone, entry.first };
+            journal.push_back(e);
+            if (journal_file) journal_file->publish(entry.first, time_ms, kVersionState, ParcelState::Free, 0, VersionOrigin::Restart);
+            ++closed;
+        }
+        return closed;
+    }
+
+    // Cuts replay snapshots from the journal, one every max(kMinSnapshotInterval,
+    // parcels known) records, so a point-in-time query never replays more than
+    // one interval however old the time, and snapshot copies cost O(1) per
+    // record amortized. Allocates, so it runs between operations rather than in
+    // them. Returns the number of snapshots taken.
+    size_t take_snapshots() {
+        size_t taken = 0;
+        while (true) {
+            size_t interval = std::max(kMinSnapshotInterval, folded.size());
+            if (journal.size() - folded_position < interval) return taken;
+            size_t end = folded_position + interval;
+            for (; folded_position < end; ++folded_position) apply(folded, journal[folded_position]);
+            ReplaySnapshot s;
+            s.time_ms = journal[end - 1].version->time_ms;
+            s.position = end;
+            sorted_images(folded, s.parcels);
+            snapshots.push_back(std::move(s));
+            ++taken;
+        }
+    }
+
+    // Every parcel as of 'time_ms': the newest snapshot taken at or before it,
+    // plus the journal records up to that time. Returns how many records were
+    // replayed on top of the snapshot ('base_time_ms' gets its time, 0 if none).
+    size_t reconstruct(int64_t time_ms, std::vector<ParcelImage>& out, int64_t& base_time_ms) const {
+        auto after = std::upper_bound(snapshots.begin(), snapshots.end(), time_ms,
+                                      [](int64_t t, const ReplaySnapshot& s) { return t < s.time_ms; });
+        std::unordered_map<int, ParcelImage> images;
+        size_t position = 0;
+        base_time_ms = 0;
+        if (after != snapshots.begin()) {
+            const ReplaySnapshot& base = *(after - 1);
+            images.reserve(base.parcels.size());
+            for (const ParcelImage& p : base.parcels) images[p.id] = p;
+            position = base.position;
+            base_time_ms = base.time_ms;
+        }
+        size_t replayed = 0;
+        for (; position < journal.size() && journal[position].version->time_ms <= time_ms; ++position, ++replayed) {
+            apply(images, journal[position]);
+        }
+        sorted_images(images, out);
+        return replayed;
+    }
+
+    size_t snapshot_count() const { return snapshots.size(); }
+
+    // Newest version of the parcel in 'slot' (kNoSlot: not held), else of departed 'id'
+    const ParcelVersion* newest(uint32_t slot, int id) const {
+        if (slot != kNoSlot) return slot < slot_head.size() ? slot_head[slot] : nullptr;
+        auto it = departed.find(id);
+        return it == departed.end() ? nullptr : it->second;
+    }
+
+    size_t size() const { return journal.size(); }
+    size_t bytes_reserved() const { return arena.bytes_reserved(); }
+};
+
+// Tags the history versions written during a scope (undo, redo, archiving)
+class VersionOriginScope {
+    ParcelHistory& history;
+public:
+    VersionOriginScope(ParcelHistory& h, VersionOrigin origin) : history(h) { history.set_origin(origin); }
+    ~VersionOriginScope() { history.set_origin(VersionOrigin::Operation); }
+    VersionOriginScope(const VersionOriginScope&) = delete;
+    VersionOriginScope& operator=(const VersionOriginScope&) = delete;
+};
+
+// Slot-based parcel storage: hot records in one contiguous array (slot-indexed),
+// cold text in another. Freed slots and cold entries are recycled.
+// This is the only copy of a parcel's payload from registration until it is
+// sealed into the archive; every other structure refers to it by slot.
+// Every occupied slot is on exactly one doubly-linked list, the one for its
+// state, so a transition is an O(1) unlink/link. Per-state counts and weight
+// totals are kept up to date by every transition and weight change.
+class ParcelStore {
+private:
+    std::vector<ParcelHot, ArenaAllocator<ParcelHot> > hot;
+    std::vector<ParcelLink, ArenaAllocator<ParcelLink> > links;
+    std::vector<ParcelCold, ArenaAllocator<ParcelCold> > cold;
+    std::vector<uint32_t, ArenaAllocator<uint32_t> > free_slots;
+    std::vector<uint32_t, ArenaAllocator<uint32_t> > free_cold;
+    uint32_t head[kStateCount]; // oldest entry of each state list
+    uint32_t tail[kStateCount]; // newest entry
+    size_t counts[kStateCount];
+    uint64_t weights_g[kStateCount];
+    ParcelHistory* history = nullptr; // told about every change when attached
+
+    void link(uint32_t slot, ParcelState state) {
+        int s = (int)state;
+        hot[slot].state = state;
+        links[slot].prev = tail[s];
+        links[slot].next = kNoSlot;
+        if (tail[s] != kNoSlot) links[tail[s]].next = slot;
+        else head[s] = slot;
+        tail[s] = slot;
+        ++counts[s];
+        weights_g[s] += hot[slot].weight_g;
+    }
+
+    void unlink(uint32_t slot) {
+        int s = (int)hot[slot].state;
+        const ParcelLink& l = links[slot];
+        if (l.prev != kNoSlot) links[l.prev].next = l.next;
+        else head[s] = l.next;
+        if (l.next != kNoSlot) links[l.next].prev = l.prev;
+        else tail[s] = l.prev;
+        --counts[s];
+        weights_g[s] -= hot[slot].weight_g;
+    }
+
+public:
+    explicit ParcelStore(Arena* arena = nullptr)
+        : hot(ArenaAllocator<ParcelHot>(arena)), links(ArenaAllocator<ParcelLink>(arena)),
+          cold(ArenaAllocator<ParcelCold>(arena)),
+          free_slots(ArenaAllocator<uint32_t>(arena)), free_cold(ArenaAllocator<uint32_t>(arena)) {
+        for (int s = 0; s < kStateCount; ++s) {
+            head[s] = tail[s] = kNoSlot;
+            counts[s] = 0;
+            weights_g[s] = 0;
+        }
+    }
+
+    void reserve(size_t parcels) {
+        hot.reserve(parcels);
+        links.reserve(parcels);
+        cold.reserve(parcels);
+        free_slots.reserve(parcels);
+        free_cold.reserve(parcels);
+    }
+
+    void attach_history(ParcelHistory* h) { history = h; }
+
+    // Stores the parcel in a free slot, in state Registered
+    uint32_t add(const Parcel& p) {
+        uint32_t c;
+        if (!free_cold.empty()) { c = free_cold.back(); free_cold.pop_back(); }
+        else { c = (uint32_t)cold.size(); cold.push_back(ParcelCold()); }
+        cold[c].sender = p.sender;
+        cold[c].recipient = p.recipient;
+        cold[c].address = p.address;
+
+        ParcelHot h;
+        h.id = p.id;
+        h.weight_g = (uint32_t)p.weight.grams();
+        h.cold = c;
+        h.priority = (uint8_t)p.priority;
+        h.state = ParcelState::Free;
+        h.spare = 0;
+
+        uint32_t slot;
+        if (!free_slots.empty()) { slot = free_slots.back(); free_slots.pop_back(); hot[slot] = h; }
+        else {
+            slot = (uint32_t)hot.size();
+            hot.push_back(h);
+            links.push_back(ParcelLink());
+        }
+        link(slot, ParcelState::Registered);
+        if (history) {
+            history->attach(slot, h.id);
+            history->append(slot, h.id, kVersionState | kVersionWeight, ParcelState::Registered, h.weight_g, &p);
+        }
+        return slot;
+    }
+
+    // Frees the slot (undone registration, or sealed into the archive)
+    void remove(uint32_t slot) {
+        unlink(slot);
+        hot[slot].state = ParcelState::Free;
+        free_cold.push_back(hot[slot].cold);
+        free_slots.push_back(slot);
+        if (history) {
+            history->append(slot, hot[slot].id, kVersionState, ParcelState::Free, 0);
+            history->detach(slot, hot[slot].id);
+        }
+    }
+
+    // Moves the parcel to another state list; the payload stays where it is
+    void transition(uint32_t slot, ParcelState to) {
+        unlink(slot);
+        link(slot, to);
+        if (history) history->append(slot, hot[slot].id, kVersionState, to, 0);
+    }
+
+    // The only way to change a stored weight, so the state totals stay exact
+    void set_weight(uint32_t slot, uint32_t grams) {
+        ParcelHot& h = hot[slot];
+        int s = (int)h.state;
+        weights_g[s] = weights_g[s] - h.weight_g + grams;
+        h.weight_g = grams;
+        if (history) history->append(slot, h.id, kVersionWeight, ParcelState::Free, grams);
+    }
+
+    ParcelHot& at(uint32_t slot) { return hot[slot]; }
+    const ParcelHot& at(uint32_t slot) const { return hot[slot]; }
+    const ParcelCold& text(uint32_t slot) const { return cold[hot[slot].cold]; }
+    ParcelState state(uint32_t slot) const { return hot[slot].state; }
+
+    // Full record (hot + cold) for the audit trail, undo and display
+    Parcel assemble(uint32_t slot) const {
+        const ParcelHot& h = hot[slot];
+        const ParcelCold& c = cold[h.cold];
+        Parcel p;
+        p.id = h.id;
+        p.sender = c.sender;
+        p.recipient = c.recipient;
+        p.address = c.address;
+        p.weight = Weight::from_grams(h.weight_g);
+        p.priority = h.priority;
+        return p;
+    }
+
+    // Linear scan touching only the hot array (16 bytes per parcel)
+    uint32_t find(int id) const {
+        for (size_t i = 0; i < hot.size(); ++i) {
+            if (hot[i].id == id && is_active(hot[i].state)) return (uint32_t)i;
+        }
+        return kNoSlot;
+    }
+
+    // Like find(), but also matches delivered and cancelled parcels still in memory
+    uint32_t find_any(int id) const {
+        for (size_t i = 0; i < hot.size(); ++i) {
+            if (hot[i].id == id && hot[i].state != ParcelState::Free) return (uint32_t)i;
+        }
+        return kNoSlot;
+    }
+
+    // Exact total over active parcels, from the running per-state totals (O(1))
+    Weight total_weight() const {
+        return Weight::from_grams((int64_t)(weights_g[(int)ParcelState::Registered] + weights_g[(int)ParcelState::Loaded] +
+                                            weights_g[(int)ParcelState::Dispatched]));
+    }
+
+    // Exact total over one state list (O(1))
+    Weight total_weight(ParcelState state) const { return Weight::from_grams((int64_t)weights_g[(int)state]); }
+
+    template <typename Visitor>
+    void for_each_live(Visitor visit) const {
+        for (const auto& h : hot) if (is_active(h.state)) visit(h);
+    }
+
+    // Walks one state list, oldest first: visit(slot, hot record)
+    template <typename Visitor>
+    void for_each_in(ParcelState state, Visitor visit) const {
+        for (uint32_t slot = head[(int)state]; slot != kNoSlot; slot = links[slot].next) visit(slot, hot[slot]);
+    }
+
+    uint32_t first_in(ParcelState state) const { return head[(int)state]; }
+    uint32_t next_in_state(uint32_t slot) const { return links[slot].next; }
+    size_t count(ParcelState state) const { return counts[(int)state]; }
+
+    // Active parcels (Registered + Loaded + Dispatched)
+    size_t size() const {
+        return counts[(int)ParcelState::Registered] + counts[(int)ParcelState::Loaded] + counts[(int)ParcelState::Dispatched];
+    }
+};
+
+// Owning reference to a loaded parcel's place in the loading queue. Only the
+// queue mints handles, when a parcel is pushed (and it refuses a slot it
+// already holds); a handle leaves it only when popped for dispatch, where the
+// dispatcher consumes it with release(). Move-only, so there is never more
+// than one per loaded parcel and none outlives the dispatch.
+class ParcelHandle {
+private:
+    friend class LoadingQueue;
+    uint32_t slot_;
+
+    explicit ParcelHandle(uint32_t slot) : slot_(slot) {}
+
+public:
+    ParcelHandle() : slot_(kNoSlot) {}
+    ParcelHandle(ParcelHandle&& other) noexcept : slot_(other.slot_) { other.slot_ = kNoSlot; }
+    ParcelHandle& operator=(ParcelHandle&& other) noexcept {
+        slot_ = other.slot_;
+        other.slot_ = kNoSlot;
+        return *this;
+    }
+    ParcelHandle(const ParcelHandle&) = delete;
+    ParcelHandle& operator=(const ParcelHandle&) = delete;
+
+    uint32_t slot() const { return slot_; }
+    bool valid() const { return slot_ != kNoSlot; }
+
+    // Consumes the handle: ownership of the slot passes back to the store
+    uint32_t release() {
+        uint32_t slot = slot_;
+        slot_ = kNoSlot;
+        return slot;
+    }
+};
+static_assert(sizeof(ParcelHandle) == 4, "Handles must stay one slot index");
+
+// Loading queue: binary heap of handles keyed on priority (smaller number is
+// served first). Entries carry the handle and its sort key only.
+class LoadingQueue {
+private:
+    struct Entry {
+        uint32_t priority;
+        ParcelHandle handle;
+
+        bool operator<(const Entry& other) const { return priority > other.priority; }
+    };
+    std::vector<Entry, ArenaAllocator<Entry> > heap;
+    // Heap index of each queued slot (kNoSlot when not queued), kept up to date
+    // by every move, so a specific parcel is taken out in O(log n) without a scan
+    std::vector<uint32_t, ArenaAllocator<uint32_t> > position;
+
+    void place(size_t i, Entry&& e) {
+        position[e.handle.slot()] = (uint32_t)i;
+        heap[i] = std::move(e);
+    }
+
+    void sift_up(size_t i) {
+        Entry e = std::move(heap[i]);
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (!(heap[parent] < e)) break;
+            place(i, std::move(heap[parent]));
+            i = parent;
+        }
+        place(i, std::move(e));
+    }
+
+    void sift_down(size_t i) {
+        Entry e = std::move(heap[i]);
+        size_t n = heap.size();
+        while (true) {
+            size_t child = 2 * i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && heap[child] < heap[child + 1]) ++child;
+            if (!(e < heap[child])) break;
+            place(i, std::move(heap[child]));
+            i = child;
+        }
+        place(i, std::move(e));
+    }
+
+    // Moves the handle at heap index i out, filling the hole with the last entry
+    ParcelHandle remove_at(size_t i) {
+        ParcelHandle handle = std::move(heap[i].handle);
+        position[handle.slot()] = kNoSlot;
+        size_t last = heap.size() - 1;
+        if (i != last) {
+            place(i, std::move(heap[last]));
+            heap.pop_back();
+            if (i > 0 && heap[(i - 1) / 2] < heap[i]) sift_up(i);
+            else sift_down(i);
+        } else {
+            heap.pop_back();
+        }
+        return handle;
+    }
+
+    // After a whole-heap rebuild (make_heap, sort, compaction)
+    void reindex() {
+        for (size_t i = 0; i < heap.size(); ++i) position[heap[i].handle.slot()] = (uint32_t)i;
+    }
+
+    void track(uint32_t slot) {
+        if (slot >= position.size()) position.resize(slot + 1, kNoSlot);
+    }
+
+public:
+    explicit LoadingQueue(Arena* arena = nullptr)
+        : heap(ArenaAllocator<Entry>(arena)), position(ArenaAllocator<uint32_t>(arena)) {}
+
+    void reserve(size_t parcels) {
+        heap.reserve(parcels);
+        position.reserve(parcels);
+    }
+
+    bool holds(uint32_t slot) const { return slot < position.size() && position[slot] != kNoSlot; }
+
+    // Mints the handle of a newly loaded parcel. False if the slot is already queued.
+    bool push(uint32_t slot, int priority) {
+        if (holds(slot)) return false;
+        track(slot);
+        Entry e = { (uint32_t)priority, ParcelHandle(slot) };
+        heap.push_back(std::move(e));
+        sift_up(heap.size() - 1);
+        return true;
+    }
+
+    // Adds many parcels at once. Appends them all, then rebuilds the heap with
+    // one O(n) make_heap, unless the batch is small next to the queue, in
+    // which case sifting each one up is cheaper. Slots already queued are skipped.
+    template <typename PriorityOf>
+    void push_bulk(const std::vector<uint32_t>& slots, PriorityOf priority_of) {
+        size_t before = heap.size();
+        for (uint32_t slot : slots) {
+            if (holds(slot)) continue;
+            track(slot);
+            position[slot] = (uint32_t)heap.size(); // a duplicate in 'slots' is skipped too
+            Entry e = { (uint32_t)priority_of(slot), ParcelHandle(slot) };
+            heap.push_back(std::move(e));
+        }
+        if (heap.size() - before > before / 4) {
+            std::make_heap(heap.begin(), heap.end());
+            reindex();
+        } else {
+            for (size_t i = before; i < heap.size(); ++i) sift_up(i);
+        }
+    }
+
+    // Moves the most urgent handle out of the queue
+    ParcelHandle pop() { return remove_at(0); }
+
+    // Moves the most urgent handles out in one call, passing each to sink(handle):
+    // at most max_parcels of them, stopping before the first parcel that would take
+    // the total weight (weight_of(slot), grams) past budget_g. Small batches pop one
+    // at a time, O(k log n); a batch of more than an eighth of the queue sorts the
+    // heap once instead. The sorted remainder is already a valid heap.
+    template <typename WeightOf, typename Sink>
+    size_t pop_batch(size_t max_parcels, uint64_t budget_g, WeightOf weight_of, Sink sink) {
+        size_t taken = 0;
+        uint64_t weight = 0;
+        if (max_parcels <= heap.size() / 8) {
+            while (taken < max_parcels && !heap.empty()) {
+                uint64_t w = weight_of(heap.front().handle.slot());
+                if (weight + w > budget_g) break;
+                weight += w;
+                sink(pop());
+                ++taken;
+            }
+            return taken;
+        }
+        std::sort(heap.begin(), heap.end(), [](const Entry& a, const Entry& b) { return b < a; });
+        while (taken < max_parcels && taken < heap.size()) {
+            uint64_t w = weight_of(heap[taken].handle.slot());
+            if (weight + w > budget_g) break;
+            weight += w;
+            position[heap[taken].handle.slot()] = kNoSlot;
+            sink(std::move(heap[taken].handle));
+            ++taken;
+        }
+        heap.erase(heap.begin(), heap.begin() + taken);
+        reindex();
+        return taken;
+    }
+
+    // Drops every entry whose slot matches drop(slot) in one pass, then re-heapifies once
+    template <typename SlotPredicate>
+    size_t remove_if(SlotPredicate drop) {
+        size_t kept = 0;
+        for (size_t i = 0; i < heap.size(); ++i) {
+            uint32_t slot = heap[i].handle.slot();
+            if (drop(slot)) {
+                position[slot] = kNoSlot;
+                continue;
+            }
+            if (kept != i) heap[kept] = std::move(heap[i]);
+            ++kept;
+        }
+        size_t removed = heap.size() - kept;
+        if (removed == 0) return 0;
+        heap.erase(heap.begin() + kept, heap.end());
+        std::make_heap(heap.begin(), heap.end());
+        reindex();
+        return removed;
+    }
+
+    // Takes a specific parcel back out and drops its handle (delivered or
+    // cancelled while loaded, or a replica following a dispatch): O(log n)
+    // through its position. False if the slot was not queued.
+    bool take(uint32_t slot) {
+        if (!holds(slot)) return false;
+        remove_at(position[slot]);
+        return true;
+    }
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+};
+
+enum class ActionType : uint8_t { Add, Update, Delete, Cancel, Dispatch, Group, BulkUpdate, Transaction, Reverted };
+
+inline const char* action_name(ActionType type) {
+    switch (type) {
+        case ActionType::Add: return "ADD";
+        case ActionType::Update: return "UPDATE";
+        case ActionType::Delete: return "DELETE";
+        case ActionType::Cancel: return "CANCEL";
+        case ActionType::Dispatch: return "DISPATCH";
+        case ActionType::Group: return "GROUP";
+        case ActionType::BulkUpdate: return "BULK UPDATE";
+        case ActionType::Transaction: return "TRANSACTION";
+        case ActionType::Reverted: return "REVERTED";
+    }
+    return "?";
+}
+
+// Headers that stand for several entries and are undone as one action
+inline bool is_compound(ActionType type) {
+    return type == ActionType::Group || type == ActionType::BulkUpdate || type == ActionType::Transaction;
+}
+
+// Undo entries refer to the parcel's slot instead of holding a copy of it.
+// The slot is only trusted while it still holds the same id.
+// A bulk operation records one entry per parcel followed by a Group header
+// whose 'members' says how many entries below it belong to the group; undo
+// pops and reverts the whole group as one action. Bulk weight corrections
+// record a single BulkUpdate entry instead; its 'members' old weights sit on
+// top of the manager's separate log of OldWeight records. A Transaction header
+// closes everything recorded since begin_transaction(), nested headers included;
+// its 'members' counts raw stack entries.
+//
+// Every parcel action is also a version of its parcel: it links to the previous
+// entry that touched the same parcel, so each parcel has a newest-first chain
+// through the stack (and through the OldWeight log for bulk corrections).
+// A version reference is a stack position, or a log index tagged with kLogVersion.
+// An entry undone out of order is left in place as a Reverted tombstone, so
+// positions and group sizes stay valid.
+const uint32_t kNoVersion = 0xFFFFFFFFu;
+const uint32_t kLogVersion = 0x80000000u;
+
+struct Action {
+    ActionType type; 
+    ParcelState from; // DELETE / CANCEL: the state the parcel left
+    uint32_t slot;    // Parcel's slot in the store
+    int id;
+    union {
+        uint32_t members;      // Group / Transaction: number of entries below; BulkUpdate: old weights
+        uint32_t prev_version; // parcel actions: previous version of the same parcel
+    };
+    Weight before;    // UPDATE: the weight before the change
+};
+static_assert(sizeof(Action) == 24, "Undo entries must stay compact");
+
+// Compact undo record of one bulk weight correction: just the previous weight
+struct OldWeight {
+    uint32_t slot;
+    int32_t id;       // checked against the slot before restoring
+    uint32_t weight_g;
+    uint32_t prev_version;
+};
+
+// Result of a batched dispatch: the slots dispatched (their handles consumed), most urgent first
+struct DispatchManifest {
+    std::vector<uint32_t> slots;
+    Weight total_weight;
+};
+
+// LIFO stack of undo entries kept in fixed-size blocks carved from an Arena.
+// Emptied blocks go on a free list and are reused, so push/pop never touch
+// the general-purpose heap once the arena has grown to the working size.
+// reset() (on checkpoint) drops the whole history and rewinds the arena.
+class UndoStack {
+private:
+    static const size_t kBlockActions = 256;
+    struct Block {
+        Block* prev;
+        size_t count;
+        Action items[kBlockActions];
+    };
+    Arena arena;
+    Block* top_block = nullptr;
+    Block* free_blocks = nullptr;
+    std::vector<Block*> table;  // live blocks, oldest first: entry i is in table[i / kBlockActions]
+    size_t total = 0;
+
+public:
+    UndoStack() : arena(sizeof(Block) * 16) {}
+    UndoStack(const UndoStack&) = delete;
+    UndoStack& operator=(const UndoStack&) = delete;
+
+    // Pre-carves enough free blocks for 'actions' entries
+    void reserve(size_t actions) {
+        table.reserve((actions + kBlockActions - 1) / kBlockActions);
+        size_t blocks = 0;
+        for (Block* b = top_block; b; b = b->prev) ++blocks;
+        for (Block* b = free_blocks; b; b = b->prev) ++blocks;
+        while (blocks * kBlockActions < actions) {
+            Block* block = static_cast<Block*>(arena.allocate(sizeof(Block), alignof(Block)));
+            if (!block) return;
+            block->prev = free_blocks;
+            free_blocks = block;
+            ++blocks;
+        }
+    }
+
+    bool push(const Action& action) {
+        if (!top_block || top_block->count == kBlockActions) {
+            Block* block = free_blocks;
+            if (block) free_blocks = block->prev;
+            else block = static_cast<Block*>(arena.allocate(sizeof(Block), alignof(Block)));
+            if (!block) return false;
+            block->prev = top_block;
+            block->count = 0;
+            top_block = block;
+            table.push_back(block);
+        }
+        top_block->items[top_block->count++] = action;
+        ++total;
+        return true;
+    }
+
+    const Action& top() const { return top_block->items[top_block->count - 1]; }
+
+    // Entry at 'position' (0 = oldest); every block but the top one is full
+    Action& at(size_t position) { return table[position / kBlockActions]->items[position % kBlockActions]; }
+
+    // Visits entries from the top down for as long as visit(action) returns true
+    template <typename Visitor>
+    void for_each_from_top(Visitor visit) const {
+        for (const Block* b = top_block; b; b = b->prev) {
+            for (size_t i = b->count; i-- > 0;) {
+                if (!visit(b->items[i])) return;
+            }
+        }
+    }
+
+    void pop() {
+        --top_block->count;
+        --total;
+        if (top_block->count == 0) {
+            Block* empty_block = top_block;
+            top_block = empty_block->prev;
+            table.pop_back();
+            empty_block->prev = free_blocks;
+            free_blocks = empty_block;
+        }
+    }
+
+    void reset() {
+        top_block = nullptr;
+        free_blocks = nullptr;
+        table.clear();
+        total = 0;
+        arena.reset();
+    }
+
+    bool empty() const { return total == 0; }
+    size_t size() const { return total; }
+    size_t bytes_reserved() const { return arena.bytes_reserved(); }
+};
+
+
+// ---- Action log replay ----
+// An action log lists operations one per line, in the order they happened:
+//   REGISTER <id> <sender> <recipient> <address> <weight_kg> <priority>
+//   UPDATE <id> <weight_kg>
+//   LOAD <id> | DISPATCH <id> | DELIVER <id> | CANCEL <id>
+enum class LogOp : uint8_t { Register, Update, Load, Dispatch, Deliver, Cancel };
+
+// One parsed line. REGISTER keeps a pointer to its text fields in the log buffer;
+// they are only copied out (and long ones interned) when merging, on one thread.
+struct LogRecord {
+    LogOp op;
+    uint8_t priority;
+    int32_t id;
+    uint32_t weight_g;
+    const char* text;
+};
+
+// A parcel's final state after folding all of its records
+struct ReplayImage {
+    int32_t id;
+    uint32_t weight_g;
+    uint8_t priority;
+    ParcelState state;
+    const char* text; // sender recipient address, from the REGISTER line
+};
+
+struct ReplayStats {
+    size_t records = 0;   // well-formed lines
+    size_t rejected = 0;  // malformed lines and operations invalid for the parcel's state
+    size_t parcels = 0;   // parcels merged into the manager
+    size_t conflicts = 0; // parcels skipped: id already taken here (or another shard's, in auto-id mode)
+    unsigned threads = 0;
+    double replay_ms = 0; // parse + fold, in parallel
+    double merge_ms = 0;
+};
+
+// Splits off the next whitespace-separated token of the current line
+inline bool next_log_token(const char*& p, const char* end, const char*& token, size_t& len) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    token = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+    len = (size_t)(p - token);
+    return len > 0;
+}
+
+// Numeric fields are read from the next token only, so strtol/strtod can
+// never skip the line's end and pick up a number from the following line
+inline bool next_log_long(const char*& p, const char* end, long& value) {
+    const char* token;
+    size_t len;
+    if (!next_log_token(p, end, token, len)) return false;
+    char* after;
+    value = std::strtol(token, &after, 10);
+    return after == token + len;
+}
+
+inline bool next_log_double(const char*& p, const char* end, double& value) {
+    const char* token;
+    size_t len;
+    if (!next_log_token(p, end, token, len)) return false;
+    char* after;
+    value = std::strtod(token, &after);
+    return after == token + len;
+}
+
+// Event-sourced replay of an action log on several threads. Phase one parses
+// one newline-aligned chunk of the log per thread and buckets each record by
+// parcel id. Phase two gives each thread one id partition and folds its
+// buckets chunk by chunk, so every parcel still sees its records in log
+// order. The caller merges the resulting images into its containers.
+class ActionLogReplay {
+private:
+    const std::string& log;
+    unsigned threads;
+    std::vector<std::vector<LogRecord> > records;               // per chunk
+    std::vector<std::vector<std::vector<uint32_t> > > buckets;  // [chunk][partition] -> indexes into records[chunk]
+    std::vector<std::vector<ReplayImage> > images;              // per partition
+    std::vector<size_t> parse_rejects, fold_rejects;
+
+    unsigned partition_of(int32_t id) const { return (unsigned)(((uint32_t)id * 2654435761u) % threads); }
+
+    static bool parse_line(const char* p, const char* end, LogRecord& r) {
+        const char* token;
+        size_t len;
+        if (!next_log_token(p, end, token, len)) return false;
+        auto is = [&](const char* word) { return std::strlen(word) == len && std::memcmp(word, token, len) == 0; };
+        if (is("REGISTER")) r.op = LogOp::Register;
+        else if (is("UPDATE")) r.op = LogOp::Update;
+        else if (is("LOAD")) r.op = LogOp::Load;
+        else if (is("DISPATCH")) r.op = LogOp::Dispatch;
+        else if (is("DELIVER")) r.op = LogOp::Deliver;
+        else if (is("CANCEL")) r.op = LogOp::Cancel;
+        else return false;
+        long id;
+        if (!next_log_long(p, end, id) || id <= 0 || id > std::numeric_limits<int32_t>::max()) return false;
+        r.id = (int32_t)id;
+        r.priority = 0;
+        r.weight_g = 0;
+        r.text = nullptr;
+        if (r.op == LogOp::Register) {
+            r.text = p;
+            for (int field = 0; field < 3; ++field) {
+                if (!next_log_token(p, end, token, len)) return false;
+            }
+        }
+        if (r.op == LogOp::Register || r.op == LogOp::Update) {
+            double kg;
+            if (!next_log_double(p, end, kg)) return false;
+            Weight w = Weight::from_kg(kg);
+            if (!w.valid()) return false;
+            r.weight_g = (uint32_t)w.grams();
+        }
+        if (r.op == LogOp::Register) {
+            long priority;
+            if (!next_log_long(p, end, priority) || priority < 1 || priority > 5) return false;
+            r.priority = (uint8_t)priority;
+        }
+        return !next_log_token(p, end, token, len); // trailing tokens make the line malformed
+    }
+
+    void parse_chunk(unsigned chunk, const char* begin, const char* end) {
+        for (const char* line = begin; line < end;) {
+            const char* eol = static_cast<const char*>(std::memchr(line, '\n', (size_t)(end - line)));
+            if (!eol) eol = end;
+            LogRecord r;
+            const char* token;
+            size_t len;
+            const char* probe = line;
+            if (parse_line(line, eol, r)) {
+                buckets[chunk][partition_of(r.id)].push_back((uint32_t)records[chunk].size());
+                records[chunk].push_back(r);
+            } else if (next_log_token(probe, eol, token, len)) {
+                ++parse_rejects[chunk]; // blank lines are not counted
+            }
+            line = eol + 1;
+        }
+    }
+
+    // Same validity rules as the live operations
+    void fold_partition(unsigned partition) {
+        std::unordered_map<int32_t, ReplayImage> parcels;
+        for (unsigned chunk = 0; chunk < threads; ++chunk) {
+            for (uint32_t index : buckets[chunk][partition]) {
+                const LogRecord& r = records[chunk][index];
+                auto it = parcels.find(r.id);
+                if (r.op == LogOp::Register) {
+                    if (it != parcels.end()) { ++fold_rejects[partition]; continue; }
+                    ReplayImage image = { r.id, r.weight_g, r.priority, ParcelState::Registered, r.text };
+                    parcels.insert(std::make_pair(r.id, image));
+                    continue;
+                }
+                if (it == parcels.end() || !is_active(it->second.state)) { ++fold_rejects[partition]; continue; }
+                ReplayImage& image = it->second;
+                switch (r.op) {
+                    case LogOp::Update: image.weight_g = r.weight_g; break;
+                    case LogOp::Load:
+                        if (image.state != ParcelState::Registered) { ++fold_rejects[partition]; break; }
+                        image.state = ParcelState::Loaded;
+                        break;
+                    case LogOp::Dispatch:
+                        if (image.state != ParcelState::Loaded) { ++fold_rejects[partition]; break; }
+                        image.state = ParcelState::Dispatched;
+                        break;
+                    case LogOp::Deliver: image.state = ParcelState::Delivered; break;
+                    case LogOp::Cancel: image.state = ParcelState::Cancelled; break;
+                    case LogOp::Register: break;
+                }
+            }
+        }
+        images[partition].reserve(parcels.size());
+        for (const auto& entry : parcels) images[partition].push_back(entry.second);
+    }
+
+    template <typename Work>
+    void run_on_threads(Work work) {
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.push_back(std::thread(work, t));
+        work(0u);
+        for (std::thread& th : pool) th.join();
+    }
+
+public:
+    // At most one thread per 64 KiB of log
+    ActionLogReplay(const std::string& buffer, unsigned max_threads)
+        : log(buffer),
+          threads((unsigned)std::max<size_t>(1, std::min<size_t>(max_threads, buffer.size() / (64 * 1024) + 1))),
+          records(threads), buckets(threads, std::vector<std::vector<uint32_t> >(threads)), images(threads),
+          parse_rejects(threads, 0), fold_rejects(threads, 0) {}
+
+    void run() {
+        // Chunk boundaries moved forward to the next line start
+        std::vector<size_t> bounds(threads + 1, log.size());
+        bounds[0] = 0;
+        for (unsigned t = 1; t < threads; ++t) {
+            size_t eol = log.find('\n', std::max(bounds[t - 1], log.size() * t / threads));
+            bounds[t] = eol == std::string::npos ? log.size() : eol + 1;
+        }
+        const char* base = log.data();
+        run_on_threads([&](unsigned t) { parse_chunk(t, base + bounds[t], base + bounds[t + 1]); });
+        run_on_threads([&](unsigned p) { fold_partition(p); });
+    }
+
+    unsigned thread_count() const { return threads; }
+
+    size_t record_count() const {
+        size_t n = 0;
+        for (const auto& chunk : records) n += chunk.size();
+        return n;
+    }
+
+    size_t rejected() const {
+        size_t n = 0;
+        for (unsigned t = 0; t < threads; ++t) n += parse_rejects[t] + fold_rejects[t];
+        return n;
+    }
+
+    // Final images, one vector per id partition
+    const std::vector<std::vector<ReplayImage> >& results() const { return images; }
+};
+
+
+class JumiaLogisticsManager {
+private:
+    ManagerConfig config;
+
+    // Backing store for every container below in zero-allocation and huge-page modes (unused otherwise)
+    Arena storage_arena;
+    // Archive segment indexes in huge-page mode
+    Arena archive_arena;
+
+    // Change stream fed by the history (open only with --cdc)
+    CdcStream cdc;
+
+    // The history's own journal file, <archive_prefix>_history_*.cdc, read back at start-up
+    CdcStream history_file;
+
+    // Hot columns and aggregates for dashboards in other processes (open only with --shm)
+    SharedView shared_view;
+
+    // Parcel events for plugins, fed by the history; metrics plugin state once attached
+    EventBus events;
+    std::shared_ptr<EventMetrics> event_metrics;
+
+    // Append-only version chain of every parcel, written by the store on each change
+    ParcelHistory history;
+
+    // Slot store holding every parcel until it is archived: contiguous hot records plus a cold text store
+    ParcelStore active_parcels;
+    
+    // Priority Queue for organized loading and urgent delivery handling [7, 12] (handles only)
+    LoadingQueue loading_queue;  
+    
+    // Stack for undo/redo based on LIFO principle [5, 12] (arena-backed blocks)
+    UndoStack undo_stack;              
+    
+    // Delivered parcels and audit trail [9, 12]: the store's DELIVERED state list
+
+    // Old weights for BulkUpdate undo entries, newest at the back (16 bytes per parcel)
+    std::vector<OldWeight> old_weights;
+
+    // Per slot: newest version (undo entry or log record) of the parcel held there
+    std::vector<uint32_t, ArenaAllocator<uint32_t> > version_head;
+
+    // Undone actions, most recently undone on top. Same entry layout as the undo
+    // stack, read forwards: UPDATE's 'before' is the weight to reapply, ADD's
+    // 'slot' indexes the parcel saved in redo_parcels, and a BulkUpdate's
+    // 'members' weights to reapply sit on top of redo_weights. Any new change
+    // empties it.
+    UndoStack redo_stack;
+    std::vector<Parcel> redo_parcels;
+    std::vector<OldWeight> redo_weights;
+    bool redoing = false; // set while redo re-records what it reapplies
+
+    // Loaded parcels leaving the queue while a group is undone or redone, removed in one sweep
+    bool defer_queue_drops = false;
+    std::vector<uint32_t> queue_drops;
+
+    // Open transaction: undo stack depth at begin_transaction()
+    bool transaction_open = false;
+    size_t transaction_start = 0;
+
+    // Replication: the stream to replicas (--replicate), or the link to a primary (--replica-of).
+    // A replica applies batches on the link's thread under replica_lock, which the
+    // menu also holds while it runs, and refuses changes until promoted.
+    ReplicationSource replication;
+    ReplicaLink replica;
+    std::mutex replica_lock;
+    bool read_only = false;
+    std::vector<uint32_t> replica_slots;  // primary's slot -> slot here
+    std::unordered_map<uint32_t, std::string> replica_texts; // primary's pooled text by its pool index
+    std::string replica_error;
+
+    // Existence filters: every id ever registered, and every id delivered (incl. archived).
+    // Heap-backed: rebuild_filter() replaces the table, which would strand the old one in an arena.
+    CuckooFilter known_ids;
+    CuckooFilter delivered_ids;
+    ParcelArchive archive;
+
+    // Allocations charged to each core operation (non-zero only with JUMIA_ALLOC_AUDIT)
+    OpAllocStats op_allocs[kOpCount];
+
+    // Auto-id mode: id-indexed array of store slots. Entry i belongs to sequence
+    // id_base + i. Delivered and cancelled parcels keep their entry until their
+    // slot is freed (undone registration, archiving); retired entries hold kNoSlot.
+    // Lookup is one array index. Heap-backed, since compaction erases and shrinks it.
+    std::vector<uint32_t> id_index;
+    int id_base = 1;          // Sequence number held by id_index[0]
+    int next_sequence = 1;    // Next sequence number to issue
+    size_t retired_prefix = 0; // Leading retired slots, dropped by compact_id_index()
+
+    Arena* storage() {
+        return config.zero_alloc || config.huge_pages != HugePages::Off ? &storage_arena : nullptr;
+    }
+
+    int sequence_of(int id) const { return id & kSequenceMask; }
+
+    int issue_id() {
+        int id = (config.shard << kShardBits) | next_sequence;
+        ++next_sequence;
+        return id;
+    }
+
+    // Points the array entry for 'id' at its store slot (growing the array as needed)
+    void index_parcel(int id, uint32_t slot) {
+        int seq = sequence_of(id);
+        if (seq < id_base) {
+            // Restoring an id whose range was already compacted away: re-open it at the front
+            id_index.insert(id_index.begin(), id_base - seq, kNoSlot);
+            retired_prefix += id_base - seq;
+            id_base = seq;
+        }
+        size_t entry = seq - id_base;
+        if (entry >= id_index.size()) id_index.resize(entry + 1, kNoSlot);
+        id_index[entry] = slot;
+        if (entry < retired_prefix) retired_prefix = entry;
+    }
+
+    void retire_id(int id) {
+        int seq = sequence_of(id);
+        if (seq < id_base || seq - id_base >= (int)id_index.size()) return;
+        id_index[seq - id_base] = kNoSlot;
+        while (retired_prefix < id_index.size() && id_index[retired_prefix] == kNoSlot) {
+            ++retired_prefix;
+        }
+        compact_id_index();
+    }
+
+    // Drops the retired leading id range once it makes up half of the array,
+    // so memory follows the parcels in memory rather than every id ever issued
+    void compact_id_index() {
+        if (retired_prefix < 64 || retired_prefix * 2 < id_index.size()) return;
+        id_index.erase(id_index.begin(), id_index.begin() + retired_prefix);
+        id_base += (int)retired_prefix;
+        retired_prefix = 0;
+        // Shrinking reallocates, which zero-allocation mode does not allow mid-operation
+        if (!config.zero_alloc && id_index.capacity() > 2 * id_index.size() + 64) id_index.shrink_to_fit();
+    }
+
+    // Slot of any parcel still in memory (delivered and cancelled included):
+    // array index in auto-id mode, hot-array scan otherwise
+    uint32_t find_in_memory(int id) const {
+        if (config.auto_ids) {
+            if ((id >> kShardBits) != config.shard) return kNoSlot;
+            int seq = sequence_of(id);
+            if (seq < id_base || seq - id_base >= (int)id_index.size()) return kNoSlot;
+            return id_index[seq - id_base];
+        }
+        return active_parcels.find_any(id);
+    }
+
+    // Single lookup point for active parcels: array index in auto-id mode, hot-array scan otherwise
+    uint32_t find_active(int id) const {
+        if (config.auto_ids) {
+            uint32_t slot = find_in_memory(id);
+            return slot != kNoSlot && is_active(active_parcels.state(slot)) ? slot : kNoSlot;
+        }
+        return active_parcels.find(id);
+    }
+
+    // Frees the slot of a delivered or cancelled parcel along with its id-array entry
+    void release_inactive(uint32_t slot) {
+        int id = active_parcels.at(slot).id;
+        active_parcels.remove(slot);
+        if (config.auto_ids) retire_id(id);
+    }
+
+    // Adds a parcel to the store and keeps the id array in step
+    uint32_t insert_active(const Parcel& p) {
+        uint32_t slot = active_parcels.add(p);
+        if (config.auto_ids) index_parcel(p.id, slot);
+        return slot;
+    }
+
+    // Takes a loaded parcel's handle out of the queue: at once, or at the end
+    // of the group being undone or redone (see sweep_queue_drops())
+    void drop_from_queue(uint32_t slot) {
+        if (defer_queue_drops) queue_drops.push_back(slot);
+        else loading_queue.take(slot);
+    }
+
+    // Defers queue removals until sweep_queue_drops(): a group touching most of
+    // the queue then costs one O(n) pass instead of k O(log n) removals
+    void defer_queue_removals() { defer_queue_drops = true; }
+
+    void sweep_queue_drops() {
+        defer_queue_drops = false;
+        if (queue_drops.empty()) return;
+        if (queue_drops.size() <= loading_queue.size() / 16) { // a few: take each through its position
+            for (uint32_t slot : queue_drops) loading_queue.take(slot);
+            queue_drops.clear();
+            return;
+        }
+        std::sort(queue_drops.begin(), queue_drops.end());
+        loading_queue.remove_if([&](uint32_t slot) { return std::binary_search(queue_drops.begin(), queue_drops.end(), slot); });
+        queue_drops.clear();
+    }
+
+    // Removes an active parcel outright, taking its handle back from the queue if it was loaded
+    void erase_active(uint32_t slot) {
+        int id = active_parcels.at(slot).id;
+        if (active_parcels.state(slot) == ParcelState::Loaded) drop_from_queue(slot);
+        active_parcels.remove(slot);
+        if (config.auto_ids) retire_id(id);
+    }
+
+    // Active -> Delivered / Cancelled: drops the queue handle (the id-array entry stays)
+    void leave_active(uint32_t slot, ParcelState to) {
+        if (active_parcels.state(slot) == ParcelState::Loaded) drop_from_queue(slot);
+        active_parcels.transition(slot, to);
+    }
+
+    // Registered -> Loaded for every slot, then one bulk build of the queue
+    size_t enqueue_bulk(const std::vector<uint32_t>& slots) {
+        if (!slots.empty()) drop_redo();
+        for (uint32_t slot : slots) active_parcels.transition(slot, ParcelState::Loaded);
+        loading_queue.push_bulk(slots, [&](uint32_t slot) { return active_parcels.at(slot).priority; });
+        return slots.size();
+    }
+
+    // Reverse of leave_active(), back to the recorded state
+    void reenter_active(uint32_t slot, ParcelState to) {
+        active_parcels.transition(slot, to);
+        if (to == ParcelState::Loaded) loading_queue.push(slot, active_parcels.at(slot).priority);
+    }
+
+    // Opens the history's journal file next to the archive. With 'restore', the
+    // versions of earlier runs are read back first, the parcels those runs
+    // left unarchived are closed as lost, and replay snapshots are cut again.
+    void open_history_file(bool restore) {
+        std::string prefix = config.archive_prefix + "_history";
+        if (restore) {
+            CdcCursor cursor(prefix);
+            std::vector<CdcRecord> batch;
+            while (cursor.poll(batch, kCdcSegmentRecords) > 0) {
+                for (const CdcRecord& r : batch) history.restore(r);
+                batch.clear();
+            }
+        }
+        if (!history_file.open(prefix)) {
+            std::cout << "WARNING: Could not open history journal " << prefix << "; history will not outlive this run." << std::endl;
+            return;
+        }
+        history.attach_journal_file(&history_file);
+        if (restore) {
+            history.close_lost(wall_clock_ms());
+            history.take_snapshots();
+        }
+    }
+
+    // Rebuilds a filter at double capacity from the authoritative containers.
+    // A failed insert would leave a false negative (and let a duplicate id
+    // through), so the rebuild starts over at double the size until every id fits.
+    void rebuild_filter(CuckooFilter& filter, bool delivered_only) {
+        size_t expected = filter.capacity() * 2;
+        while (true) {
+            filter.reset(expected);
+            bool complete = true;
+            auto put = [&](int id) { if (complete && !filter.insert(id)) complete = false; };
+            if (!delivered_only) {
+                active_parcels.for_each_live([&](const ParcelHot& h) { put(h.id); });
+            }
+            active_parcels.for_each_in(ParcelState::Delivered, [&](uint32_t, const ParcelHot& h) { put(h.id); });
+            if (!delivered_only) {
+                active_parcels.for_each_in(ParcelState::Cancelled, [&](uint32_t, const ParcelHot& h) { put(h.id); });
+            }
+            archive.for_each_id(put);
+            if (complete) return;
+            expected *= 2;
+        }
+    }
+
+    void filter_insert(CuckooFilter& filter, int id, bool delivered_only) {
+        while (!filter.insert(id)) rebuild_filter(filter, delivered_only);
+    }
+
+    // Exact check behind the filters; the archive is only read on a filter hit
+    bool id_in_use(int id) {
+        if (!known_ids.might_contain(id)) return false;
+        if (find_active(id) != kNoSlot) return true;
+        if (active_parcels.find_any(id) != kNoSlot) return true; // delivered or cancelled, still in memory
+        if (!delivered_ids.might_contain(id)) return false;
+        Parcel archived;
+        return archive.find(id, archived);
+    }
+
+    uint32_t newest_version(uint32_t slot) const {
+        return slot < version_head.size() ? version_head[slot] : kNoVersion;
+    }
+
+    void set_newest_version(uint32_t slot, uint32_t version) {
+        if (slot >= version_head.size()) version_head.resize(slot + 1, kNoVersion);
+        version_head[slot] = version;
+    }
+
+    // Drops 'version' from the front of its parcel's chain when it is being popped.
+    // Entries of archived parcels may trail behind a reused slot, hence the check.
+    void unlink_version(uint32_t slot, uint32_t version, uint32_t prev) {
+        if (newest_version(slot) == version) set_newest_version(slot, prev);
+    }
+
+    // Starts serving replicas. The parcels held now go out first, so the stream
+    // describes the whole state even on a promoted replica.
+    bool start_replication() {
+        if (!replication.open(config.replicate_path, config.auto_ids, config.shard)) return false;
+        int64_t now = wall_clock_ms();
+        for (int s = (int)ParcelState::Registered; s < kStateCount; ++s) {
+            active_parcels.for_each_in((ParcelState)s, [&](uint32_t slot, const ParcelHot& h) {
+                Parcel p = active_parcels.assemble(slot);
+                replication.publish(slot, h.id, kVersionState | kVersionWeight, ParcelState::Registered, h.weight_g,
+                                    VersionOrigin::Operation, now, &p);
+                if (h.state != ParcelState::Registered) {
+                    replication.publish(slot, h.id, kVersionState, h.state, 0, VersionOrigin::Operation, now, nullptr);
+                }
+            });
+        }
+        history.attach_replication(&replication);
+        return true;
+    }
+
+    uint32_t replica_slot(uint32_t primary_slot) const {
+        return primary_slot < replica_slots.size() ? replica_slots[primary_slot] : kNoSlot;
+    }
+
+    // Replica: applies a batch of the primary's records (on the link's thread).
+    // False stops replication.
+    bool apply_replicated(const ReplicationRecord* records, size_t count) {
+        std::lock_guard<std::mutex> guard(replica_lock);
+        for (size_t i = 0; i < count; ++i) {
+            const ReplicationRecord& r = records[i];
+            VersionOriginScope tag(history, r.origin);
+            switch (r.op) {
+                case ReplicaOp::Hello: {
+                    ReplicaHello hello;
+                    std::memcpy(&hello, r.payload, sizeof(hello));
+                    if ((hello.auto_ids != 0) != config.auto_ids || (config.auto_ids && hello.shard != config.shard)) {
+                        replica_error = "the primary's --auto-ids / --shard settings differ from this replica's";
+                        return false;
+                    }
+                    break;
+                }
+                case ReplicaOp::Text: {
+                    ReplicaText text;
+                    std::memcpy(&text, r.payload, sizeof(text));
+                    std::string& value = replica_texts[text.pool_index];
+                    value.resize(text.length);
+                    std::memcpy(&value[0] + text.offset, text.bytes, std::min<size_t>(sizeof(text.bytes), text.length - text.offset));
+                    break;
+                }
+                case ReplicaOp::Add: {
+                    Parcel p;
+                    std::memcpy(&p, r.payload, sizeof(p));
+                    // Pooled text refers to the primary's pool: intern it here
+                    if (p.sender.pooled()) p.sender.assign(replica_texts[p.sender.pool_index()]);
+                    if (p.recipient.pooled()) p.recipient.assign(replica_texts[p.recipient.pool_index()]);
+                    if (p.address.pooled()) p.address.assign(replica_texts[p.address.pool_index()]);
+                    uint32_t slot = insert_active(p);
+                    filter_insert(known_ids, p.id, false);
+                    if (config.auto_ids && sequence_of(p.id) >= next_sequence) next_sequence = sequence_of(p.id) + 1;
+                    if (r.slot >= replica_slots.size()) replica_slots.resize(r.slot + 1, kNoSlot);
+                    replica_slots[r.slot] = slot;
+                    break;
+                }
+                case ReplicaOp::Transition: {
+                    uint32_t slot = replica_slot(r.slot);
+                    if (slot == kNoSlot) break;
+                    ParcelState from = active_parcels.state(slot);
+                    int id = active_parcels.at(slot).id;
+                    if (from == ParcelState::Loaded) loading_queue.take(slot);
+                    active_parcels.transition(slot, r.state);
+                    if (r.state == ParcelState::Loaded) loading_queue.push(slot, active_parcels.at(slot).priority);
+                    if (r.state == ParcelState::Delivered) filter_insert(delivered_ids, id, true);
+                    else if (from == ParcelState::Delivered) delivered_ids.erase(id);
+                    break;
+                }
+                case ReplicaOp::Weight: {
+                    uint32_t slot = replica_slot(r.slot);
+                    if (slot != kNoSlot) active_parcels.set_weight(slot, r.weight_g);
+                    break;
+                }
+                case ReplicaOp::Remove: {
+                    uint32_t slot = replica_slot(r.slot);
+                    if (slot == kNoSlot) break;
+                    int id = active_parcels.at(slot).id;
+                    if (is_active(active_parcels.state(slot))) erase_active(slot);
+                    else release_inactive(slot);
+                    replica_slots[r.slot] = kNoSlot;
+                    if (r.origin == VersionOrigin::Archive) break;
+                    // Registration undone on the primary
+                    known_ids.erase(id);
+                    if (config.auto_ids && sequence_of(id) == next_sequence - 1) --next_sequence;
+                    break;
+                }
+                case ReplicaOp::Heartbeat: break;
+            }
+        }
+        return true;
+    }
+
+    // A new change makes everything on the redo stack stale
+    void drop_redo() {
+        if (redoing || redo_stack.empty()) return;
+        redo_stack.reset();
+        redo_parcels.clear();
+        redo_weights.clear();
+    }
+
+    // Helper function for the Stack (Push operation) [5, 6, 13]
+    bool record_action(ActionType type, uint32_t slot, int id, Weight before = Weight(),
+                       ParcelState from = ParcelState::Free) {
+        drop_redo();
+        // A registration starts a new chain, even if the slot held another parcel before
+        uint32_t prev = type == ActionType::Add ? kNoVersion : newest_version(slot);
+        Action act = {type, from, slot, id, {prev}, before};
+        if (undo_stack.push(act)) {
+            set_newest_version(slot, (uint32_t)undo_stack.size() - 1);
+            return true;
+        }
+        std::cout << "WARNING: Out of memory for undo history; this action cannot be undone." << std::endl;
+        return false;
+    }
+
+    // Closes a group (or transaction) over the 'members' entries just recorded
+    void record_group(uint32_t members, ActionType type = ActionType::Group) {
+        if (members == 0) return;
+        Action header = {type, ParcelState::Free, kNoSlot, 0, {members}, Weight()};
+        if (!undo_stack.push(header)) {
+            std::cout << "WARNING: Out of memory for undo history; the batch will undo one parcel at a time." << std::endl;
+        }
+    }
+
+    // Reverts one recorded (non-group) action. False when the parcel has since
+    // moved on, e.g. it was sealed into the archive.
+    bool revert_action(const Action& a) {
+        // The recorded slot is only used while it still holds this parcel in the expected state
+        const ParcelHot& h = active_parcels.at(a.slot);
+        if (h.id != a.id) return false;
+        switch (a.type) {
+            case ActionType::Add:
+                // Reverse an ADD: Delete the item added [19]
+                if (!is_active(h.state)) return false;
+                erase_active(a.slot);
+                known_ids.erase(a.id);
+                // Hand the id back if it was the newest one, so issued ids stay dense
+                if (config.auto_ids && sequence_of(a.id) == next_sequence - 1) --next_sequence;
+                return true;
+            case ActionType::Update:
+                // Reverse an UPDATE: Restore the old weight saved in 'a.before' [16]
+                if (!is_active(h.state)) return false;
+                active_parcels.set_weight(a.slot, (uint32_t)a.before.grams());
+                return true;
+            case ActionType::Delete:
+                // Reverse a DELETE: move it from the DELIVERED list back to the state it left [20]
+                if (h.state != ParcelState::Delivered) return false;
+                delivered_ids.erase(a.id);
+                reenter_active(a.slot, a.from);
+                return true;
+            case ActionType::Cancel:
+                if (h.state != ParcelState::Cancelled) return false;
+                reenter_active(a.slot, a.from);
+                return true;
+            case ActionType::Dispatch:
+                // Back onto the truck: Dispatched -> Loaded, handle pushed back into the queue
+                if (h.state != ParcelState::Dispatched) return false;
+                reenter_active(a.slot, ParcelState::Loaded);
+                return true;
+            case ActionType::Group:
+            case ActionType::BulkUpdate:
+            case ActionType::Transaction:
+            case ActionType::Reverted:
+                break;
+        }
+        return false;
+    }
+
+    // revert_action() that also saves what redo needs: the weight being undone,
+    // or a copy of the parcel whose registration is being undone
+    bool revert_for_redo(const Action& a) {
+        Action redo = a;
+        if (a.type == ActionType::Update) redo.before = Weight::from_grams(active_parcels.at(a.slot).weight_g);
+        if (a.type == ActionType::Add) {
+            redo.slot = (uint32_t)redo_parcels.size();
+            redo_parcels.push_back(active_parcels.assemble(a.slot));
+        }
+        bool reverted = revert_action(a);
+        // Without room on the redo stack the action simply cannot be redone
+        if ((!reverted || !redo_stack.push(redo)) && a.type == ActionType::Add) redo_parcels.pop_back();
+        return reverted;
+    }
+
+    // Reapplies one undone action through its stored slot and re-records it for undo.
+    // False when the parcel has changed since it was undone.
+    bool reapply_action(const Action& r) {
+        if (r.type == ActionType::Add) {
+            Parcel p = redo_parcels[r.slot];
+            redo_parcels.resize(r.slot);
+            if (id_in_use(p.id)) return false;
+            uint32_t slot = insert_active(p);
+            if (config.auto_ids && sequence_of(p.id) == next_sequence) ++next_sequence; // the id was handed back
+            filter_insert(known_ids, p.id, false);
+            record_action(ActionType::Add, slot, p.id);
+            return true;
+        }
+        if (!still_held(r.slot, r.id)) return false;
+        ParcelState state = active_parcels.state(r.slot);
+        switch (r.type) {
+            case ActionType::Update:
+                if (!is_active(state)) return false;
+                record_action(ActionType::Update, r.slot, r.id, Weight::from_grams(active_parcels.at(r.slot).weight_g));
+                active_parcels.set_weight(r.slot, (uint32_t)r.before.grams());
+                return true;
+            case ActionType::Delete:
+                if (state != r.from) return false;
+                leave_active(r.slot, ParcelState::Delivered);
+                filter_insert(delivered_ids, r.id, true);
+                record_action(ActionType::Delete, r.slot, r.id, Weight(), r.from);
+                return true;
+            case ActionType::Cancel:
+                if (state != r.from) return false;
+                leave_active(r.slot, ParcelState::Cancelled);
+                record_action(ActionType::Cancel, r.slot, r.id, Weight(), r.from);
+                return true;
+            case ActionType::Dispatch:
+                if (state != ParcelState::Loaded) return false;
+                drop_from_queue(r.slot);
+                active_parcels.transition(r.slot, ParcelState::Dispatched);
+                record_action(ActionType::Dispatch, r.slot, r.id);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Reapplies the newest undone bulk correction as a new BulkUpdate entry
+    uint32_t reapply_bulk_update(uint32_t members) {
+        size_t log_before = old_weights.size();
+        for (uint32_t i = 0; i < members && !redo_weights.empty(); ++i) {
+            OldWeight w = redo_weights.back();
+            redo_weights.pop_back();
+            if (!still_held(w.slot, w.id) || !is_active(active_parcels.state(w.slot))) continue;
+            OldWeight old = { w.slot, w.id, active_parcels.at(w.slot).weight_g, kNoVersion };
+            old_weights.push_back(old);
+            active_parcels.set_weight(w.slot, w.weight_g);
+        }
+        uint32_t applied = (uint32_t)(old_weights.size() - log_before);
+        log_bulk_update(log_before);
+        return applied;
+    }
+
+    // Closes the bulk correction whose old weights were logged from 'log_before' on
+    // under one BulkUpdate entry, and threads each record into its parcel's chain
+    void log_bulk_update(size_t log_before) {
+        uint32_t applied_count = (uint32_t)(old_weights.size() - log_before);
+        if (applied_count == 0) return;
+        drop_redo();
+        Action header = {ActionType::BulkUpdate, ParcelState::Free, kNoSlot, 0, {applied_count}, Weight()};
+        if (!undo_stack.push(header)) {
+            old_weights.resize(log_before);
+            std::cout << "WARNING: Out of memory for undo history; this action cannot be undone." << std::endl;
+            return;
+        }
+        for (size_t i = log_before; i < old_weights.size(); ++i) {
+            old_weights[i].prev_version = newest_version(old_weights[i].slot);
+            set_newest_version(old_weights[i].slot, kLogVersion | (uint32_t)i);
+        }
+    }
+
+    // Pops the newest undone entry with all of its members and reapplies them,
+    // oldest first, re-recording grouped entries under a header of the same kind.
+    // Returns the number of redo entries consumed; 'reapplied' counts parcel changes.
+    size_t redo_top(uint32_t& reapplied) {
+        Action r = redo_stack.top();
+        redo_stack.pop();
+        if (r.type == ActionType::BulkUpdate) {
+            reapplied += reapply_bulk_update(r.members);
+            return 1;
+        }
+        if (!is_compound(r.type)) {
+            if (reapply_action(r)) ++reapplied;
+            return 1;
+        }
+        size_t undo_before = undo_stack.size();
+        size_t consumed = 0;
+        while (consumed < r.members && !redo_stack.empty()) consumed += redo_top(reapplied);
+        uint32_t members = (uint32_t)(undo_stack.size() - undo_before);
+        Action header = {r.type, ParcelState::Free, kNoSlot, 0, {members}, Weight()};
+        if (members > 0 && !undo_stack.push(header)) {
+            std::cout << "WARNING: Out of memory for undo history; the group will undo one action at a time." << std::endl;
+        }
+        return consumed + 1;
+    }
+
+    // True while 'slot' still holds parcel 'id' in memory (not archived, not reused)
+    bool still_held(uint32_t slot, int id) const {
+        return active_parcels.at(slot).id == id && active_parcels.state(slot) != ParcelState::Free;
+    }
+
+    // Dry run over the compound entry on top of the stack: every parcel it touches
+    // must still be held in memory. Later entries have already been undone (LIFO),
+    // so this is enough for the whole group to revert without a partial result.
+    bool can_revert_top() const {
+        size_t log = old_weights.size();
+        size_t remaining = 1; // entries of this group still to inspect
+        bool ok = true;
+        undo_stack.for_each_from_top([&](const Action& a) {
+            if (a.type == ActionType::Group || a.type == ActionType::Transaction) {
+                remaining += a.members;
+            } else if (a.type == ActionType::Reverted) {
+                // already undone on its own
+            } else if (a.type == ActionType::BulkUpdate) {
+                for (uint32_t i = 0; i < a.members && log > 0 && ok; ++i) {
+                    const OldWeight& w = old_weights[--log];
+                    ok = still_held(w.slot, w.id);
+                }
+            } else {
+                ok = still_held(a.slot, a.id);
+            }
+            return ok && --remaining > 0;
+        });
+        return ok;
+    }
+
+    // Pops the top entry together with all of its members (nested groups too),
+    // reverting them newest first when 'apply' is set. Returns the number of
+    // stack entries consumed; 'reverted' counts the parcel changes undone.
+    size_t pop_top(bool apply, uint32_t& reverted) {
+        Action a = undo_stack.top();
+        undo_stack.pop();
+        if (a.type == ActionType::BulkUpdate) {
+            reverted += revert_bulk_update(a.members, apply);
+            return 1;
+        }
+        if (a.type == ActionType::Reverted) return 1;
+        if (a.type != ActionType::Group && a.type != ActionType::Transaction) {
+            unlink_version(a.slot, (uint32_t)undo_stack.size(), a.prev_version);
+            if (apply && revert_for_redo(a)) ++reverted;
+            return 1;
+        }
+        size_t redo_before = redo_stack.size();
+        size_t consumed = 0;
+        while (consumed < a.members && !undo_stack.empty()) consumed += pop_top(apply, reverted);
+        // Members went onto the redo stack newest first, so redo meets the oldest first
+        uint32_t redo_members = (uint32_t)(redo_stack.size() - redo_before);
+        Action header = {a.type, ParcelState::Free, kNoSlot, 0, {redo_members}, Weight()};
+        if (redo_members > 0) redo_stack.push(header);
+        return consumed + 1;
+    }
+
+    // Pops the log records of the newest bulk correction, restoring the old
+    // weights when 'apply' is set; returns how many were restored
+    uint32_t revert_bulk_update(uint32_t members, bool apply = true) {
+        uint32_t restored = 0;
+        for (uint32_t i = 0; i < members && !old_weights.empty(); ++i) {
+            OldWeight w = old_weights.back();
+            old_weights.pop_back();
+            unlink_version(w.slot, kLogVersion | (uint32_t)old_weights.size(), w.prev_version);
+            if (!apply) continue;
+            const ParcelHot& h = active_parcels.at(w.slot);
+            if (h.id != w.id || !is_active(h.state)) continue;
+            OldWeight redo = { w.slot, w.id, h.weight_g, kNoVersion };
+            redo_weights.push_back(redo);
+            active_parcels.set_weight(w.slot, w.weight_g);
+            ++restored;
+        }
+        Action header = {ActionType::BulkUpdate, ParcelState::Free, kNoSlot, 0, {restored}, Weight()};
+        if (restored > 0 && !redo_stack.push(header)) redo_weights.resize(redo_weights.size() - restored);
+        return restored;
+    }
+
+public:
+    JumiaLogisticsManager() : JumiaLogisticsManager(ManagerConfig()) {}
+    explicit JumiaLogisticsManager(const ManagerConfig& cfg)
+        : config(cfg),
+          storage_arena(cfg.huge_pages != HugePages::Off ? kHugePageSize : 1 << 20, cfg.huge_pages),
+          archive_arena(kHugePageSize, cfg.huge_pages),
+          history(storage()),
+          active_parcels(storage()),
+          loading_queue(storage()),
+          version_head(ArenaAllocator<uint32_t>(storage())),
+          known_ids(1024),
+          delivered_ids(1024),
+          archive(cfg.archive_prefix, cfg.huge_pages != HugePages::Off ? &archive_arena : nullptr),
+          op_allocs() {
+        active_parcels.attach_history(&history);
+        history.attach_events(&events);
+        // Before anything else writes a version; a replica's history comes from its primary
+        if (config.persist_history && config.replica_of.empty()) open_history_file(true);
+        if (!config.cdc_prefix.empty()) {
+            if (cdc.open(config.cdc_prefix)) history.attach_cdc(&cdc);
+            else std::cout << "WARNING: Could not open change stream " << config.cdc_prefix << "; CDC is off." << std::endl;
+        }
+        if (config.reserve_parcels > 0) reserve(config.reserve_parcels);
+        archive.load_existing([&](int id) {
+            filter_insert(known_ids, id, false);
+            filter_insert(delivered_ids, id, true);
+            // Never re-issue an id that already sits in this shard's archive
+            if (config.auto_ids && (id >> kShardBits) == config.shard && sequence_of(id) >= next_sequence) {
+                next_sequence = sequence_of(id) + 1;
+                id_base = next_sequence;
+            }
+        });
+        // After the archive has loaded, so the view starts with its totals
+        if (!config.shm_name.empty()) {
+            uint32_t rows = (uint32_t)std::max<size_t>(kSharedViewMinRows, config.reserve_parcels);
+            if (shared_view.create(config.shm_name, rows)) {
+                shared_view.add_archived(archive.size(), (uint64_t)archive.total_weight().grams());
+                history.attach_view(&shared_view);
+            } else {
+                std::cout << "WARNING: Could not create shared view " << config.shm_name << "; it is off." << std::endl;
+            }
+        }
+        if (!config.replica_of.empty()) {
+            read_only = true;
+            bool linked = replica.open(config.replica_of, [this](const ReplicationRecord* records, size_t count) {
+                return apply_replicated(records, count);
+            });
+            if (!linked) {
+                std::cout << "WARNING: Could not reach a primary at " << config.replica_of
+                          << "; running as a disconnected replica (promote it with menu 26)." << std::endl;
+            }
+        } else if (!config.replicate_path.empty() && !start_replication()) {
+            std::cout << "WARNING: Could not serve replicas on " << config.replicate_path << "; replication is off." << std::endl;
+        }
+    }
+
+    // The replica link calls back into the manager: stop it before anything else goes
+    ~JumiaLogisticsManager() {
+        replica.close();
+        replication.close();
+    }
+
+    // ---- Core operations: no console I/O, audited for allocations ----
+
+    // Registers p, issuing its id in auto-id mode. False if the id is taken
+    // (manual mode) or the shard has run out of ids (auto mode).
+    bool register_parcel(Parcel& p) {
+        AllocScope audit(op_allocs[kOpRegister]);
+        if (config.auto_ids) {
+            if (next_sequence > kSequenceMask) return false;
+            p.id = issue_id(); // Issued only once every field is valid, so ids stay gap-free
+        } else if (id_in_use(p.id)) {
+            return false;
+        }
+        uint32_t slot = insert_active(p);
+        filter_insert(known_ids, p.id, false);
+        record_action(ActionType::Add, slot, p.id);
+        return true;
+    }
+
+    bool update_weight(int id, Weight new_weight) {
+        AllocScope audit(op_allocs[kOpUpdate]);
+        uint32_t slot = find_active(id);
+        if (slot == kNoSlot) return false;
+        ParcelHot& h = active_parcels.at(slot);
+        record_action(ActionType::Update, slot, id, Weight::from_grams(h.weight_g)); // UPDATE records the previous weight
+        active_parcels.set_weight(slot, (uint32_t)new_weight.grams()); // Update element [16]
+        return true;
+    }
+
+    // Applies a file of (id, new weight) corrections in one pass. In manual-id
+    // mode this is a hash join: the corrections are hashed by id (a later row
+    // for the same id wins) and one walk over the active lists probes them. In
+    // auto-id mode each hashed row probes the id-indexed slot array instead. The
+    // state weight totals are adjusted per parcel, never recomputed, and the
+    // undo record is one BulkUpdate entry over 16-byte old-weight records.
+    size_t update_weights_bulk(const std::vector<std::pair<int, Weight> >& corrections) {
+        AllocScope audit(op_allocs[kOpUpdateBulk]);
+        size_t log_before = old_weights.size();
+        auto apply = [&](uint32_t slot, Weight w) {
+            const ParcelHot& h = active_parcels.at(slot);
+            OldWeight old = { slot, h.id, h.weight_g, kNoVersion };
+            old_weights.push_back(old);
+            active_parcels.set_weight(slot, (uint32_t)w.grams());
+        };
+        std::unordered_map<int, Weight> by_id(corrections.size() * 2); // build side
+        for (const auto& c : corrections) by_id[c.first] = c.second;
+        if (config.auto_ids) {
+            for (const auto& c : by_id) {
+                uint32_t slot = find_active(c.first);
+                if (slot != kNoSlot) apply(slot, c.second);
+            }
+        } else {
+            for (int s = (int)ParcelState::Registered; s <= (int)ParcelState::Dispatched; ++s) {
+                active_parcels.for_each_in((ParcelState)s, [&](uint32_t slot, const ParcelHot& h) {
+                    auto match = by_id.find(h.id);
+                    if (match != by_id.end()) apply(slot, match->second);
+                });
+            }
+        }
+        uint32_t applied_count = (uint32_t)(old_weights.size() - log_before);
+        log_bulk_update(log_before);
+        return applied_count;
+    }
+
+    // Registered -> Loaded. False unless the parcel is active and still Registered
+    bool load_parcel(int id) {
+        AllocScope audit(op_allocs[kOpLoad]);
+        uint32_t slot = find_active(id);
+        if (slot == kNoSlot || active_parcels.state(slot) != ParcelState::Registered) return false;
+        drop_redo();
+        active_parcels.transition(slot, ParcelState::Loaded);
+        loading_queue.push(slot, active_parcels.at(slot).priority); // Enqueue based on priority (handle only)
+        return true;
+    }
+
+    // Loaded -> Dispatched for the most urgent parcel; its handle moves out of the
+    // queue and is consumed here, leaving its slot in 'dispatched'.
+    // Recorded for undo like each member of a batch dispatch.
+    bool dispatch_next(uint32_t& dispatched) {
+        AllocScope audit(op_allocs[kOpDispatch]);
+        if (loading_queue.empty()) return false;
+        // Dequeue: remove the highest priority item from the front [7, 17]
+        uint32_t slot = loading_queue.pop().release();
+        dispatched = slot;
+        active_parcels.transition(slot, ParcelState::Dispatched);
+        record_action(ActionType::Dispatch, slot, active_parcels.at(slot).id);
+        return true;
+    }
+
+    // Resolves an id list against the active set in one sort-merge pass: returns
+    // the slots of listed parcels whose state is accepted by want(state), in id
+    // order. Unknown and duplicate ids are skipped. In auto-id mode the active set
+    // is the id-ordered slot array; otherwise the wanted state lists, sorted by id.
+    template <typename StatePredicate>
+    std::vector<uint32_t> resolve_active(std::vector<int> ids, StatePredicate want) {
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        std::vector<uint32_t> slots;
+        slots.reserve(std::min(ids.size(), active_parcels.size()));
+        if (config.auto_ids) {
+            for (int id : ids) {
+                uint32_t slot = find_active(id);
+                if (slot != kNoSlot && want(active_parcels.state(slot))) slots.push_back(slot);
+            }
+            return slots;
+        }
+        std::vector<std::pair<int, uint32_t> > active;
+        active.reserve(active_parcels.size());
+        for (int s = (int)ParcelState::Registered; s <= (int)ParcelState::Dispatched; ++s) {
+            if (!want((ParcelState)s)) continue;
+            active_parcels.for_each_in((ParcelState)s, [&](uint32_t slot, const ParcelHot& h) {
+                active.push_back(std::make_pair(h.id, slot));
+            });
+        }
+        std::sort(active.begin(), active.end());
+        size_t a = 0;
+        for (int id : ids) {
+            while (a < active.size() && active[a].first < id) ++a;
+            if (a < active.size() && active[a].first == id) slots.push_back(active[a].second);
+        }
+        return slots;
+    }
+
+    // Loads every REGISTERED parcel whose id is in 'ids' in one pass; parcels in
+    // any other state are skipped
+    size_t load_bulk(const std::vector<int>& ids) {
+        AllocScope audit(op_allocs[kOpLoadBulk]);
+        std::vector<uint32_t> slots = resolve_active(ids, [](ParcelState s) { return s == ParcelState::Registered; });
+        return enqueue_bulk(slots);
+    }
+
+    // Loads every REGISTERED parcel with priority <= max_priority (one walk of the REGISTERED list)
+    size_t load_where(int max_priority) {
+        AllocScope audit(op_allocs[kOpLoadBulk]);
+        std::vector<uint32_t> slots;
+        slots.reserve(active_parcels.count(ParcelState::Registered));
+        active_parcels.for_each_in(ParcelState::Registered, [&](uint32_t slot, const ParcelHot& h) {
+            if (h.priority <= max_priority) slots.push_back(slot);
+        });
+        return enqueue_bulk(slots);
+    }
+
+    // Dispatches the most urgent loaded parcels in one operation: at most
+    // max_parcels (0 = no limit), stopping before the first parcel that would
+    // exceed the weight budget (zero weight = no limit). Lower-priority parcels
+    // never jump ahead of one that did not fit. Recorded as one grouped undo entry.
+    size_t dispatch_batch(size_t max_parcels, Weight budget, DispatchManifest& manifest) {
+        AllocScope audit(op_allocs[kOpDispatchBatch]);
+        manifest.slots.clear();
+        manifest.total_weight = Weight();
+        if (max_parcels == 0) max_parcels = loading_queue.size();
+        uint64_t budget_g = budget.grams() > 0 ? (uint64_t)budget.grams() : std::numeric_limits<uint64_t>::max();
+        manifest.slots.reserve(std::min(max_parcels, loading_queue.size()));
+
+        int64_t total_g = 0;
+        uint32_t recorded = 0;
+        loading_queue.pop_batch(max_parcels, budget_g,
+            [&](uint32_t slot) { return (uint64_t)active_parcels.at(slot).weight_g; },
+            [&](ParcelHandle handle) {
+                uint32_t slot = handle.release();
+                const ParcelHot& h = active_parcels.at(slot);
+                active_parcels.transition(slot, ParcelState::Dispatched);
+                total_g += h.weight_g;
+                if (record_action(ActionType::Dispatch, slot, h.id)) ++recorded;
+                manifest.slots.push_back(slot);
+            });
+        record_group(recorded);
+        manifest.total_weight = Weight::from_grams(total_g);
+        return manifest.slots.size();
+    }
+
+    // Any active state -> Delivered (a loaded parcel is taken off the queue)
+    bool deliver_parcel(int id) {
+        AllocScope audit(op_allocs[kOpDeliver]);
+        uint32_t slot = find_active(id);
+        if (slot == kNoSlot) return false;
+        ParcelState from = active_parcels.state(slot);
+        leave_active(slot, ParcelState::Delivered); // Audit list insertion (Requirement 5)
+        filter_insert(delivered_ids, id, true);
+        record_action(ActionType::Delete, slot, id, Weight(), from); // Record deleted item for potential reversal
+        return true;
+    }
+
+    // Completes every active parcel listed in a returned manifest in one pass:
+    // sort-merge against the active set, append them all to the DELIVERED list,
+    // clear any that were still loaded out of the queue with a single sweep, and
+    // record one grouped undo entry. Returns how many were delivered.
+    size_t deliver_bulk(const std::vector<int>& ids) {
+        AllocScope audit(op_allocs[kOpDeliverBulk]);
+        std::vector<uint32_t> slots = resolve_active(ids, [](ParcelState) { return true; });
+        bool any_loaded = false;
+        uint32_t recorded = 0;
+        for (uint32_t slot : slots) {
+            ParcelState from = active_parcels.state(slot);
+            int id = active_parcels.at(slot).id;
+            any_loaded |= from == ParcelState::Loaded;
+            active_parcels.transition(slot, ParcelState::Delivered); // Audit list insertion (Requirement 5)
+            filter_insert(delivered_ids, id, true);
+            if (record_action(ActionType::Delete, slot, id, Weight(), from)) ++recorded;
+        }
+        if (any_loaded) {
+            loading_queue.remove_if([&](uint32_t slot) { return active_parcels.state(slot) == ParcelState::Delivered; });
+        }
+        record_group(recorded);
+        return slots.size();
+    }
+
+    // Any active state -> Cancelled. The parcel stays in memory and its id stays taken
+    bool cancel_parcel(int id) {
+        AllocScope audit(op_allocs[kOpCancel]);
+        uint32_t slot = find_active(id);
+        if (slot == kNoSlot) return false;
+        ParcelState from = active_parcels.state(slot);
+        leave_active(slot, ParcelState::Cancelled);
+        record_action(ActionType::Cancel, slot, id, Weight(), from);
+        return true;
+    }
+
+    // Rebuilds parcels from an action log (see ActionLogReplay) and merges them
+    // in: each parcel is inserted once in its final state, loaded ones go into
+    // the queue with one heap build, and the whole replay is recorded as one
+    // transaction, so a single undo takes it back out. Parcels whose id is
+    // already taken here, or that belong to another shard in auto-id mode, are
+    // skipped. False if the log cannot be read.
+    bool replay_action_log(const std::string& path, ReplayStats& stats) {
+        AllocScope audit(op_allocs[kOpReplay]);
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in) return false;
+        std::string log((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        unsigned threads = config.replay_threads ? config.replay_threads : std::max(1u, std::thread::hardware_concurrency());
+        ActionLogReplay replay(log, threads);
+        replay.run();
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+        VersionOriginScope tag(history, VersionOrigin::Replay);
+        size_t undo_before = undo_stack.size();
+        std::vector<uint32_t> to_load;
+        for (const std::vector<ReplayImage>& partition : replay.results()) {
+            for (const ReplayImage& image : partition) {
+                bool foreign = config.auto_ids && (image.id >> kShardBits) != config.shard;
+                if (foreign || id_in_use(image.id)) { ++stats.conflicts; continue; }
+                Parcel p;
+                p.id = image.id;
+                p.priority = image.priority;
+                p.weight = Weight::from_grams(image.weight_g);
+                const char* cursor = image.text;
+                const char* end = log.data() + log.size();
+                InlineString* fields[3] = { &p.sender, &p.recipient, &p.address };
+                for (InlineString* field : fields) {
+                    const char* token;
+                    size_t len;
+                    next_log_token(cursor, end, token, len);
+                    field->assign(std::string(token, len));
+                }
+                uint32_t slot = insert_active(p);
+                // Never issue an id the log already used
+                if (config.auto_ids && sequence_of(p.id) >= next_sequence) next_sequence = sequence_of(p.id) + 1;
+                filter_insert(known_ids, p.id, false);
+                record_action(ActionType::Add, slot, p.id);
+                switch (image.state) {
+                    case ParcelState::Loaded: to_load.push_back(slot); break;
+                    case ParcelState::Dispatched: active_parcels.transition(slot, ParcelState::Dispatched); break;
+                    case ParcelState::Delivered:
+                        leave_active(slot, ParcelState::Delivered);
+                        filter_insert(delivered_ids, p.id, true);
+                        record_action(ActionType::Delete, slot, p.id, Weight(), ParcelState::Registered);
+                        break;
+                    case ParcelState::Cancelled:
+                        leave_active(slot, ParcelState::Cancelled);
+                        record_action(ActionType::Cancel, slot, p.id, Weight(), ParcelState::Registered);
+                        break;
+                    default: break;
+                }
+                ++stats.parcels;
+            }
+        }
+        enqueue_bulk(to_load);
+        record_group((uint32_t)(undo_stack.size() - undo_before), ActionType::Transaction);
+
+        stats.records = replay.record_count();
+        stats.rejected = replay.rejected();
+        stats.threads = replay.thread_count();
+        stats.replay_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        stats.merge_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+        return true;
+    }
+
+    // Free per-state counts (kept by the store's state lists)
+    size_t parcels_in(ParcelState state) const { return active_parcels.count(state); }
+
+    // Visits the recorded versions of parcel 'id' newest first, following the back-pointers
+    // of that parcel's chain only (archived parcels included). The slot comes from
+    // the id array in auto-id mode, so the walk is O(k) for k versions.
+    template <typename Visitor>
+    void for_each_history(int id, Visitor visit) const {
+        for (const ParcelVersion* v = history.newest(find_in_memory(id), id); v; v = v->prev) visit(*v);
+    }
+
+    // Cuts any replay snapshots that are due (between operations: it allocates)
+    size_t take_replay_snapshots() { return history.take_snapshots(); }
+
+    // Point-in-time query: every parcel known at 'time_ms' with its state and
+    // weight then, from the nearest replay snapshot plus journal replay.
+    // Returns the number of records replayed.
+    size_t parcels_at(int64_t time_ms, std::vector<ParcelImage>& out, int64_t& base_time_ms) const {
+        return history.reconstruct(time_ms, out, base_time_ms);
+    }
+
+    // Drops the undo history; returns how many entries were discarded
+    size_t reset_undo_history() {
+        size_t dropped = undo_stack.size();
+        undo_stack.reset();
+        old_weights.clear();
+        version_head.clear();
+        transaction_start = 0;
+        drop_redo();
+        return dropped;
+    }
+
+    // Reapplies the most recently undone record (a whole group or bulk correction
+    // in one pass). Returns false if there is nothing to redo; 'reapplied' counts
+    // the parcel changes made again.
+    bool redo_last(uint32_t& reapplied) {
+        AllocScope audit(op_allocs[kOpRedo]);
+        reapplied = 0;
+        if (redo_stack.empty()) return false;
+        VersionOriginScope tag(history, VersionOrigin::Redo);
+        redoing = true;
+        defer_queue_removals();
+        redo_top(reapplied);
+        sweep_queue_drops();
+        redoing = false;
+        return true;
+    }
+
+    bool can_redo() const { return !redo_stack.empty(); }
+    const Action& next_redo() const { return redo_stack.top(); }
+
+    // Walks the version chain of parcel 'id' newest first, calling
+    // visit(version, type) for each undo entry or bulk log record that touched it,
+    // for as long as visit returns true.
+    // Costs O(k) for k versions once the slot is known: one id-array index in
+    // auto-id mode (manual ids fall back to the hot-array scan, like every lookup there).
+    template <typename Visitor>
+    void for_each_version(int id, Visitor visit) {
+        uint32_t slot = find_in_memory(id);
+        if (slot != kNoSlot) for_each_version_at(slot, id, visit);
+    }
+
+    template <typename Visitor>
+    void for_each_version_at(uint32_t slot, int id, Visitor visit) {
+        for (uint32_t v = newest_version(slot); v != kNoVersion;) {
+            if (v & kLogVersion) {
+                const OldWeight& w = old_weights[v & ~kLogVersion];
+                if (w.id != id || !visit(v, ActionType::BulkUpdate)) return;
+                v = w.prev_version;
+            } else {
+                const Action& a = undo_stack.at(v);
+                if (a.id != id || !visit(v, a.type)) return;
+                v = a.prev_version;
+            }
+        }
+    }
+
+    // Selective undo: reverts parcel 'id''s entry at stack 'position' on its own,
+    // leaving a tombstone. Only allowed while it is the newest version of the parcel;
+    // otherwise 'blocking' receives the number of later actions on that parcel
+    // and nothing changes.
+    bool undo_selected(int id, uint32_t position, size_t& blocking) {
+        AllocScope audit(op_allocs[kOpUndo]);
+        VersionOriginScope tag(history, VersionOrigin::Undo);
+        blocking = 0;
+        if (position >= undo_stack.size()) return false;
+        Action& a = undo_stack.at(position);
+        if (a.id != id || is_compound(a.type) || a.type == ActionType::Reverted || !still_held(a.slot, a.id)) return false;
+        // Every version newer than the target on the same parcel depends on it
+        for_each_version_at(a.slot, a.id, [&](uint32_t v, ActionType) {
+            if (v == position) return false;
+            ++blocking;
+            return true;
+        });
+        if (blocking > 0 || newest_version(a.slot) != position) return false;
+        uint32_t slot = a.slot, prev = a.prev_version;
+        if (!revert_action(a)) return false;
+        drop_redo(); // redo replays in stack order, which an out-of-order undo breaks
+        set_newest_version(slot, prev);
+        a.type = ActionType::Reverted;
+        return true;
+    }
+
+    // Starts collecting undo entries into one transaction. False if one is already open.
+    bool begin_transaction() {
+        if (transaction_open) return false;
+        transaction_open = true;
+        transaction_start = undo_stack.size();
+        return true;
+    }
+
+    // Closes the open transaction under one Transaction header; returns the number
+    // of entries it covers (0 when nothing was recorded or no transaction was open)
+    size_t commit_transaction() {
+        if (!transaction_open) return 0;
+        transaction_open = false;
+        size_t members = undo_stack.size() - transaction_start;
+        if (members == 0) return 0;
+        Action header = {ActionType::Transaction, ParcelState::Free, kNoSlot, 0, {(uint32_t)members}, Weight()};
+        if (!undo_stack.push(header)) {
+            std::cout << "WARNING: Out of memory for undo history; the transaction will undo one action at a time." << std::endl;
+        }
+        return members;
+    }
+
+    bool in_transaction() const { return transaction_open; }
+    size_t transaction_size() const { return transaction_open ? undo_stack.size() - transaction_start : 0; }
+
+    bool is_replica() const { return read_only; }
+
+    // Menu choices a replica serves: reports, searches and history queries
+    static bool read_only_choice(int choice) {
+        switch (choice) {
+            case 0: case 7: case 8: case 11: case 21: case 22: case 24: case 25: case 26: return true;
+            default: return false;
+        }
+    }
+
+    // Held by the menu while a command runs on a replica, so applying waits for it
+    std::unique_lock<std::mutex> lock_replica() {
+        return read_only ? std::unique_lock<std::mutex>(replica_lock) : std::unique_lock<std::mutex>();
+    }
+
+    // Replica -> primary. The state is already current; the archive index picks
+    // up segments the old primary sealed, and with --replicate this manager
+    // starts serving replicas of its own. Undo history starts empty, and the
+    // version journal file is continued from here on.
+    bool promote() {
+        if (!read_only) return false;
+        replica.close();
+        read_only = false;
+        archive.load_existing([](int) {}); // their ids are already in the filters, from the stream
+        if (config.persist_history) open_history_file(false);
+        if (!config.replicate_path.empty() && !start_replication()) {
+            std::cout << "WARNING: Could not serve replicas on " << config.replicate_path << "; replication is off." << std::endl;
+        }
+        return true;
+    }
+
+    // Plugins: 'handler' runs on the subscriber's own thread for every 'types'
+    // event from then on. Call between operations.
+    EventSubscriber& subscribe(const std::string& name, uint16_t types, Backpressure policy, size_t capacity,
+                               const std::function<void(const ParcelEvent&)>& handler) {
+        return events.subscribe(name, types, policy, capacity, handler);
+    }
+
+    // Reserves room for 'parcels' in every container, so the core operations do not
+    // allocate until that many parcels are in flight (or undo entries recorded)
+    void reserve(size_t parcels) {
+        active_parcels.reserve(parcels);
+        loading_queue.reserve(parcels);
+        id_index.reserve(parcels);
+        version_head.reserve(parcels);
+        known_ids.reset(parcels + parcels / 4);
+        delivered_ids.reset(parcels + parcels / 4);
+        undo_stack.reserve(4 * parcels); // registration, weight change, dispatch and delivery each
+        history.reserve(parcels, 6 * parcels); // registration, weight change and four state changes each
+    }
+
+    // Huge pages mapped for the storage and archive arenas, and how many the kernel actually granted
+    HugePageStats huge_page_stats() const {
+        HugePageStats storage_stats = storage_arena.huge_page_stats();
+        HugePageStats archive_stats = archive_arena.huge_page_stats();
+        HugePageStats total = { storage_stats.pages + archive_stats.pages,
+                                storage_stats.huge_pages + archive_stats.huge_pages };
+        return total;
+    }
+
+    const OpAllocStats& allocation_stats(OpKind op) const { return op_allocs[op]; }
+    void reset_allocation_stats() { for (auto& s : op_allocs) s = OpAllocStats(); }
+
+    // MOVED TO PUBLIC to allow interaction/error handling from main()
+    void clear_input() {
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+   
+    void register_parcel_interactive() {
+        Parcel p;
+        std::cout << "\n--- Register New Parcel ---" << std::endl;
+        if (!config.auto_ids) {
+            std::cout << "Enter Parcel ID: ";
+            if (!(std::cin >> p.id)) { clear_input(); std::cout << "Invalid ID." << std::endl; return; }
+            if (id_in_use(p.id)) { std::cout << "Error: Parcel ID " << p.id << " is already in use." << std::endl; return; }
+        }
+        
+        std::cout << "Enter Sender Name: "; 
+        std::cin >> p.sender;
+        
+        std::cout << "Enter Recipient Name: ";
+        std::cin >> p.recipient;
+        
+        std::cout << "Enter Address (no spaces): ";
+        std::cin >> p.address;
+        
+        std::cout << "Enter Weight (kg): ";
+        if (!(std::cin >> p.weight)) { clear_input(); std::cout << "Invalid weight." << std::endl; return; }
+        
+        std::cout << "Enter Delivery Priority (1=High, 5=Low): ";
+        if (!(std::cin >> p.priority) || p.priority < 1 || p.priority > 5) { 
+            clear_input(); 
+            std::cout << "Invalid priority. Must be between 1 and 5." << std::endl; 
+            return; 
+        }
+
+        if (!register_parcel(p)) {
+            if (config.auto_ids) std::cout << "Error: Shard " << config.shard << " has run out of ids." << std::endl;
+            else std::cout << "Error: Parcel ID " << p.id << " is already in use." << std::endl;
+            return;
+        }
+        std::cout << "\nSUCCESS: Parcel " << p.id << " registered and recorded for undo." << std::endl;
+    }
+
+    // 2. Update Parcel (Hot Record Lookup and Update) [12]
+    void update_parcel_interactive() {
+        int id;
+        Weight new_weight;
+        std::cout << "\nEnter Parcel ID to Update: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        uint32_t slot = find_active(id);
+        if (slot != kNoSlot) {
+            std::cout << "Enter New Weight for P" << id << " (Current: " << active_parcels.assemble(slot).weight << "): ";
+            if (!(std::cin >> new_weight)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+            
+            update_weight(id, new_weight);
+            std::cout << "\nSUCCESS: Parcel " << id << " updated." << std::endl;
+            return;
+        }
+        std::cout << "\nError: Parcel ID " << id << " not found in active records." << std::endl;
+    }
+
+    // 3. Load Parcel (Priority Queue Enqueue)
+    void prepare_for_loading_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID to Load onto truck: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        if (load_parcel(id)) {
+            std::cout << "\nSUCCESS: Parcel " << id << " loaded (Priority: " << (int)active_parcels.at(find_active(id)).priority << "). Will be dispatched based on urgency." << std::endl;
+            return;
+        }
+        uint32_t slot = find_active(id);
+        if (slot != kNoSlot) {
+            std::cout << "\nError: Parcel ID " << id << " is " << state_name(active_parcels.state(slot))
+                      << " and cannot be loaded again." << std::endl;
+            return;
+        }
+        std::cout << "\nError: Parcel ID " << id << " not found." << std::endl;
+    }
+
+    // 4. Dispatch Next Parcel (Priority Queue Dequeue)
+    void dispatch_next_parcel() {
+        uint32_t next_dispatch;
+        if (!dispatch_next(next_dispatch)) {
+            std::cout << "\nERROR: Loading queue is empty. (Underflow) [18]." << std::endl;
+            return;
+        }
+        const ParcelHot& h = active_parcels.at(next_dispatch);
+        std::cout << "\nDISPATCH SUCCESS: Parcel ID " << h.id << " (Priority " << (int)h.priority << ") dispatched immediately and recorded for undo." << std::endl;
+    }
+    
+    // 5. Complete Delivery (Slot Store Deletion & Array/Vector Insertion) [12, 19]
+    void complete_delivery_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID to mark as delivered: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        if (deliver_parcel(id)) {
+            std::cout << "\nSUCCESS: Parcel " << id << " marked delivered and removed from active list." << std::endl;
+            return;
+        }
+        std::cout << "\nError: Parcel ID " << id << " not found in active list." << std::endl;
+    }
+
+    // 12. Cancel Parcel (any active state -> CANCELLED)
+    void cancel_parcel_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID to cancel: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        if (cancel_parcel(id)) {
+            std::cout << "\nSUCCESS: Parcel " << id << " cancelled." << std::endl;
+            return;
+        }
+        std::cout << "\nError: Parcel ID " << id << " not found in active list." << std::endl;
+    }
+
+    // 13. Dispatch Batch (top N loaded parcels or up to a weight budget, one manifest)
+    void dispatch_batch_interactive() {
+        size_t max_parcels;
+        Weight budget;
+        std::cout << "\nMaximum parcels to dispatch (0 = no limit): ";
+        if (!(std::cin >> max_parcels)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+        std::cout << "Truck weight budget in kg (0 = no limit): ";
+        if (!(std::cin >> budget)) { clear_input(); std::cout << "Invalid weight." << std::endl; return; }
+
+        DispatchManifest manifest;
+        if (dispatch_batch(max_parcels, budget, manifest) == 0) {
+            std::cout << "\nERROR: Nothing dispatched (loading queue empty, or the first parcel exceeds the budget)." << std::endl;
+            return;
+        }
+        // Built in one buffer and flushed once
+        std::cout << "\n--- DISPATCH MANIFEST (" << manifest.slots.size() << " parcels) ---\n";
+        for (uint32_t slot : manifest.slots) {
+            const ParcelHot& h = active_parcels.at(slot);
+            const ParcelCold& c = active_parcels.text(slot);
+            std::cout << "  P" << h.id << " (Priority " << (int)h.priority << ") " << Weight::from_grams(h.weight_g)
+                      << " kg to " << c.recipient << " at " << c.address << "\n";
+        }
+        std::cout << "Total weight: " << manifest.total_weight << " kg (one undo entry)" << std::endl;
+    }
+
+    // Reads whitespace-separated parcel ids (a scanned manifest); false if the file cannot be opened
+    static bool read_id_file(const std::string& path, std::vector<int>& ids) {
+        std::ifstream in(path.c_str());
+        if (!in) return false;
+        int id;
+        while (in >> id) ids.push_back(id);
+        return true;
+    }
+
+    // 14. Bulk Load (whole wave from an id file or a priority filter, heap built in one pass)
+    void bulk_load_interactive() {
+        int mode;
+        std::cout << "\nBulk load by (1) id list file or (2) priority filter: ";
+        if (!(std::cin >> mode) || (mode != 1 && mode != 2)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        size_t loaded;
+        if (mode == 1) {
+            std::string path;
+            std::cout << "Enter id list file: ";
+            std::cin >> path;
+            std::vector<int> ids;
+            if (!read_id_file(path, ids)) { std::cout << "\nError: Could not open " << path << "." << std::endl; return; }
+            loaded = load_bulk(ids);
+            std::cout << "\nSUCCESS: " << loaded << " of " << ids.size() << " listed parcels loaded";
+            if (loaded < ids.size()) std::cout << " (the rest are unknown or not REGISTERED)";
+            std::cout << "." << std::endl;
+        } else {
+            int max_priority;
+            std::cout << "Load every REGISTERED parcel with priority up to (1-5): ";
+            if (!(std::cin >> max_priority)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+            loaded = load_where(max_priority);
+            std::cout << "\nSUCCESS: " << loaded << " parcels loaded." << std::endl;
+        }
+        std::cout << "Loading queue now holds " << loading_queue.size() << " parcels." << std::endl;
+    }
+
+    // 15. Bulk Delivery (manifest file of delivered ids, one grouped undo entry)
+    void bulk_delivery_interactive() {
+        std::string path;
+        std::cout << "\nEnter delivery manifest file: ";
+        std::cin >> path;
+        std::vector<int> ids;
+        if (!read_id_file(path, ids)) { std::cout << "\nError: Could not open " << path << "." << std::endl; return; }
+
+        size_t delivered = deliver_bulk(ids);
+        std::cout << "\nSUCCESS: " << delivered << " of " << ids.size() << " manifest entries marked delivered";
+        if (delivered < ids.size()) std::cout << " (the rest are unknown, duplicated or not active)";
+        std::cout << "." << std::endl;
+    }
+
+    void undo_last_action() {
+        AllocScope audit(op_allocs[kOpUndo]);
+        VersionOriginScope tag(history, VersionOrigin::Undo);
+        if (undo_stack.empty()) {
+            std::cout << "\nNO UNDO: Stack is empty (Underflow) [13]. No recent actions recorded." << std::endl;
+            return;
+        }
+
+        // Entries already undone selectively are skipped
+        while (!undo_stack.empty() && undo_stack.top().type == ActionType::Reverted) undo_stack.pop();
+        if (undo_stack.size() < transaction_start) transaction_start = undo_stack.size();
+        if (undo_stack.empty()) {
+            std::cout << "\nNO UNDO: Every recorded action has already been undone." << std::endl;
+            return;
+        }
+
+        // Pop the last action (LIFO) [5, 6]
+        Action last_action = undo_stack.top();
+
+        if (is_compound(last_action.type)) {
+            // Grouped record: all members revert in one pass, newest first, or none do
+            std::cout << "\n--- Undoing Action: ";
+            if (last_action.type == ActionType::BulkUpdate) {
+                std::cout << "BULK UPDATE of " << last_action.members << " weights";
+            } else if (last_action.type == ActionType::Transaction) {
+                std::cout << "TRANSACTION of " << last_action.members << " entries";
+            } else {
+                // Members are all of one kind; name the entry just below the header
+                int seen = 0;
+                ActionType member = ActionType::Group;
+                undo_stack.for_each_from_top([&](const Action& a) { member = a.type; return ++seen < 2; });
+                std::cout << "GROUP of " << last_action.members << " " << (seen == 2 ? action_name(member) : "?") << " actions";
+            }
+            std::cout << " ---" << std::endl;
+            uint32_t reverted = 0;
+            if (!can_revert_top()) {
+                pop_top(false, reverted);
+                std::cout << "UNDO FAILED: Some of these parcels have already been sealed into the archive; "
+                          << "the record was discarded and nothing was changed." << std::endl;
+            } else {
+                defer_queue_removals();
+                pop_top(true, reverted);
+                sweep_queue_drops();
+                std::cout << "UNDO SUCCESS: " << reverted << " parcel changes reverted." << std::endl;
+            }
+            if (undo_stack.size() < transaction_start) transaction_start = undo_stack.size();
+            return;
+        }
+        undo_stack.pop();
+        unlink_version(last_action.slot, (uint32_t)undo_stack.size(), last_action.prev_version);
+        if (undo_stack.size() < transaction_start) transaction_start = undo_stack.size();
+
+        std::cout << "\n--- Undoing Action: " << action_name(last_action.type) << " on Parcel ID " << last_action.id << " ---" << std::endl;
+
+        if (!revert_for_redo(last_action)) {
+            // The entry is already off the stack: say why it could not be applied
+            if (still_held(last_action.slot, last_action.id)) {
+                std::cout << "UNDO FAILED: Parcel " << last_action.id << " is now "
+                          << state_name(active_parcels.state(last_action.slot)) << "; the "
+                          << action_name(last_action.type) << " record was discarded and nothing was changed." << std::endl;
+            } else {
+                std::cout << "UNDO FAILED: Parcel " << last_action.id << " has already been sealed into the archive." << std::endl;
+            }
+            return;
+        }
+        switch (last_action.type) {
+            case ActionType::Add:
+                std::cout << "UNDO SUCCESS: Registered Parcel " << last_action.id << " removed from active list." << std::endl;
+                break;
+            case ActionType::Update:
+                std::cout << "UNDO SUCCESS: Parcel " << last_action.id << " weight restored to " << last_action.before << "." << std::endl;
+                break;
+            case ActionType::Delete:
+                std::cout << "UNDO SUCCESS: Parcel " << last_action.id << " restored to active list ("
+                          << state_name(last_action.from) << ")." << std::endl;
+                break;
+            case ActionType::Cancel:
+                std::cout << "UNDO SUCCESS: Parcel " << last_action.id << " reinstated ("
+                          << state_name(last_action.from) << ")." << std::endl;
+                break;
+            case ActionType::Dispatch:
+                std::cout << "UNDO SUCCESS: Parcel " << last_action.id << " back on the loading queue." << std::endl;
+                break;
+            case ActionType::Group:
+            case ActionType::BulkUpdate:
+            case ActionType::Transaction:
+            case ActionType::Reverted:
+                break;
+        }
+    }
+
+    // 7. Generate Summary Reports (Array/Vector and Hot Record Traversal) [12]
+    void generate_summary_reports() const {
+        // Exact integer totals in grams: active (hot array sum) + delivered + archived
+        int64_t total_grams = active_parcels.total_weight().grams() + archive.total_weight().grams();
+        size_t delivered_in_memory = active_parcels.count(ParcelState::Delivered);
+        int total_registered = active_parcels.size() + delivered_in_memory + archive.size();
+        
+        // Use an array (vector) to count pending parcels by priority
+        std::vector<int> pending_by_priority(6, 0); 
+        
+        // Traversal of active parcels (hot records only)
+        active_parcels.for_each_live([&](const ParcelHot& h) {
+            if (h.priority >= 1 && h.priority <= 5) {
+                pending_by_priority[h.priority]++;
+            }
+        });
+        // Delivered parcels still in memory (DELIVERED state list)
+        total_grams += active_parcels.total_weight(ParcelState::Delivered).grams();
+
+        std::cout << "\n--- JUMIA LOGISTICS SUMMARY REPORT ---" << std::endl;
+        std::cout << "Total Parcels Registered: " << total_registered << std::endl;
+        std::cout << "Total Parcels Delivered: " << delivered_in_memory + archive.size() << std::endl;
+        
+        // Average parcel weight calculation
+        if (total_registered > 0) {
+            std::cout << "Total Parcel Weight: " << Weight::from_grams(total_grams) << " kg" << std::endl;
+            std::cout << "Average Parcel Weight: " << Weight::from_grams(total_grams / total_registered) << " kg" << std::endl;
+        }
+        
+        // Parcels pending delivery by priority level
+        std::cout << "\nParcels Pending by Priority Level:" << std::endl;
+        for (int i = 1; i <= 5; ++i) {
+            std::cout << "  Priority " << i << ": " << pending_by_priority[i] << std::endl;
+        }
+
+        // Lifecycle state counts (kept by the state lists, no traversal)
+        std::cout << "\nParcels by Lifecycle State:" << std::endl;
+        for (int s = (int)ParcelState::Registered; s < kStateCount; ++s) {
+            std::cout << "  " << state_name((ParcelState)s) << ": " << active_parcels.count((ParcelState)s) << std::endl;
+        }
+        
+        // Delivery History and Route Summary
+        std::cout << "\nDelivery History (Audit Trail - Delivered Parcels):" << std::endl;
+        if (archive.size() > 0) {
+            std::cout << "  (" << archive.size() << " earlier deliveries sealed in " << archive.segments() << " archive segments)" << std::endl;
+        }
+        if (delivered_in_memory == 0) {
+            if (archive.size() == 0) std::cout << "  No deliveries completed yet." << std::endl;
+        } else {
+            active_parcels.for_each_in(ParcelState::Delivered, [&](uint32_t slot, const ParcelHot& h) {
+                std::cout << "  [DELIVERED] P" << h.id << " to " << active_parcels.text(slot).recipient << " (P" << (int)h.priority << ")" << std::endl;
+            });
+        }
+        std::cout << "--------------------------------------" << std::endl;
+    }
+
+    // 8. Search Parcel (existence filters first, then memory, then the archive)
+    void search_parcel_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID to search: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        if (!known_ids.might_contain(id)) {
+            std::cout << "\nParcel ID " << id << " has never been registered." << std::endl;
+            return;
+        }
+        uint32_t slot = find_active(id);
+        if (slot != kNoSlot) {
+            Parcel p = active_parcels.assemble(slot);
+            std::cout << "\n[ACTIVE] P" << p.id << " from " << p.sender << " to " << p.recipient
+                      << " at " << p.address << ", " << p.weight << " kg (P" << p.priority << "), "
+                      << state_name(active_parcels.state(slot)) << std::endl;
+            return;
+        }
+        slot = active_parcels.find_any(id);
+        if (slot != kNoSlot) {
+            const ParcelHot& h = active_parcels.at(slot);
+            std::cout << "\n[" << state_name(h.state) << "] P" << h.id << " to " << active_parcels.text(slot).recipient << " (P" << (int)h.priority << ")" << std::endl;
+            return;
+        }
+        if (delivered_ids.might_contain(id)) {
+            Parcel archived;
+            if (archive.find(id, archived)) {
+                std::cout << "\n[ARCHIVED] P" << archived.id << " to " << archived.recipient << " (P" << archived.priority << ")" << std::endl;
+                return;
+            }
+        }
+        std::cout << "\nParcel ID " << id << " has never been registered." << std::endl;
+    }
+
+    // 9. Archive Delivered Parcels (seal the audit array into an immutable segment on disk)
+    void archive_delivered_parcels() {
+        size_t delivered = active_parcels.count(ParcelState::Delivered);
+        if (delivered == 0) {
+            std::cout << "\nNothing to archive: no delivered parcels in memory." << std::endl;
+            return;
+        }
+        uint32_t cursor = active_parcels.first_in(ParcelState::Delivered);
+        bool sealed = archive.seal(delivered, [&]() {
+            Parcel p = active_parcels.assemble(cursor);
+            cursor = active_parcels.next_in_state(cursor);
+            return p;
+        });
+        if (!sealed) {
+            std::cout << "\nError: Could not write archive segment " << archive.segments() + 1 << "." << std::endl;
+            return;
+        }
+        std::cout << "\nSUCCESS: " << delivered << " delivered parcels sealed into archive segment "
+                  << archive.segments() << "." << std::endl;
+        // The archive now owns these parcels: free their slots
+        drop_redo();
+        VersionOriginScope tag(history, VersionOrigin::Archive);
+        while (active_parcels.first_in(ParcelState::Delivered) != kNoSlot) {
+            release_inactive(active_parcels.first_in(ParcelState::Delivered));
+        }
+    }
+    
+    // 10. Checkpoint: accept everything done so far and drop the undo history
+    void checkpoint_history() {
+        size_t dropped = reset_undo_history();
+        std::cout << "\nCHECKPOINT: " << dropped << " undo entries cleared; "
+                  << undo_stack.bytes_reserved() / 1024 << " KiB of undo arena kept for reuse." << std::endl;
+    }
+    
+    // 11. Allocation Audit (per-operation allocation counts since start-up)
+    void print_allocation_report() const {
+        std::cout << "\n--- ALLOCATION AUDIT ---" << std::endl;
+#ifndef JUMIA_ALLOC_AUDIT
+        std::cout << "(Built without JUMIA_ALLOC_AUDIT: only call counts are tracked.)" << std::endl;
+#endif
+        std::cout << "Mode: " << (config.zero_alloc ? "zero-allocation (storage arena)" : "heap") << std::endl;
+        for (int op = 0; op < kOpCount; ++op) {
+            const OpAllocStats& s = op_allocs[op];
+            std::cout << "  " << kOpNames[op] << ": " << s.calls << " calls, " << s.allocations
+                      << " allocations, " << s.bytes << " bytes" << std::endl;
+        }
+        std::cout << "Storage arena: " << storage_arena.bytes_reserved() / 1024 << " KiB, archive index arena: "
+                  << archive_arena.bytes_reserved() / 1024 << " KiB, undo arena: "
+                  << undo_stack.bytes_reserved() / 1024 << " KiB, history arena: "
+                  << history.bytes_reserved() / 1024 << " KiB (" << history.size() << " versions, "
+                  << history.snapshot_count() << " replay snapshots)" << std::endl;
+        if (config.huge_pages != HugePages::Off) {
+            HugePageStats pages = huge_page_stats();
+            std::cout << "Huge pages (" << huge_pages_name(config.huge_pages) << "): " << pages.huge_pages
+                      << " of " << pages.pages << " 2 MiB pages backed by huge pages" << std::endl;
+        }
+        std::cout << "------------------------" << std::endl;
+    }
+
+    // 16. Bulk Weight Corrections (file of "id weight_kg" rows, one compact undo entry)
+    void bulk_weight_update_interactive() {
+        std::string path;
+        std::cout << "\nEnter weight correction file (id weight_kg per line): ";
+        std::cin >> path;
+        std::ifstream in(path.c_str());
+        if (!in) { std::cout << "\nError: Could not open " << path << "." << std::endl; return; }
+
+        std::vector<std::pair<int, Weight> > corrections;
+        size_t rejected = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream row(line);
+            int id;
+            Weight w;
+            if (!(row >> id)) continue; // blank line
+            if (row >> w) corrections.push_back(std::make_pair(id, w));
+            else ++rejected;
+        }
+        size_t applied = update_weights_bulk(corrections);
+        std::cout << "\nSUCCESS: " << applied << " parcels reweighed from " << corrections.size() << " rows";
+        if (rejected > 0) std::cout << " (" << rejected << " rows with an invalid weight skipped)";
+        std::cout << ". Active weight now " << active_parcels.total_weight() << " kg." << std::endl;
+    }
+
+    // 17. Begin Transaction (following actions undo as one record)
+    void begin_transaction_interactive() {
+        if (!begin_transaction()) {
+            std::cout << "\nError: A transaction is already open (" << transaction_size() << " entries). Commit it first." << std::endl;
+            return;
+        }
+        std::cout << "\nSUCCESS: Transaction started. Registrations, updates and deliveries will undo as one record." << std::endl;
+    }
+
+    // 18. Commit Transaction
+    void commit_transaction_interactive() {
+        if (!in_transaction()) {
+            std::cout << "\nError: No transaction is open." << std::endl;
+            return;
+        }
+        size_t members = commit_transaction();
+        if (members == 0) {
+            std::cout << "\nSUCCESS: Transaction closed; nothing was recorded." << std::endl;
+            return;
+        }
+        std::cout << "\nSUCCESS: Transaction committed with " << members << " undo entries (one undo reverts them all)." << std::endl;
+    }
+
+    // 19. Selective Undo (revert one past action of a parcel via its version chain)
+    void selective_undo_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        size_t versions = 0;
+        std::cout << "\n--- Undo History of Parcel " << id << " (newest first) ---" << std::endl;
+        for_each_version(id, [&](uint32_t v, ActionType type) {
+            if (v & kLogVersion) std::cout << "  (bulk) ";
+            else std::cout << "  #" << v + 1 << " ";
+            std::cout << action_name(type) << (versions == 0 ? "  <- newest" : "") << std::endl;
+            ++versions;
+            return true;
+        });
+        if (versions == 0) {
+            std::cout << "No recorded actions for this parcel." << std::endl;
+            return;
+        }
+
+        long entry;
+        std::cout << "Enter entry # to revert (0 to cancel): ";
+        if (!(std::cin >> entry)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+        if (entry <= 0) return;
+        size_t blocking = 0;
+        if (undo_selected(id, (uint32_t)(entry - 1), blocking)) {
+            std::cout << "UNDO SUCCESS: Entry #" << entry << " reverted; later actions on other parcels are kept." << std::endl;
+        } else if (blocking > 0) {
+            std::cout << "UNDO FAILED: " << blocking << " later action(s) on this parcel depend on entry #" << entry
+                      << ". Revert those first." << std::endl;
+        } else {
+            std::cout << "UNDO FAILED: Entry #" << entry << " is not a revertible action of parcel " << id << "." << std::endl;
+        }
+    }
+
+    // 20. Redo Last Undone Action
+    void redo_last_action() {
+        if (!can_redo()) {
+            std::cout << "\nNO REDO: Nothing has been undone since the last change." << std::endl;
+            return;
+        }
+        Action next = next_redo();
+        std::cout << "\n--- Redoing Action: " << action_name(next.type);
+        if (is_compound(next.type)) std::cout << " of " << next.members << " entries";
+        else std::cout << " on Parcel ID " << (next.type == ActionType::Add ? redo_parcels[next.slot].id : next.id);
+        std::cout << " ---" << std::endl;
+
+        uint32_t reapplied = 0;
+        redo_last(reapplied);
+        if (reapplied == 0) {
+            std::cout << "REDO FAILED: The parcels involved have changed since the undo." << std::endl;
+        } else {
+            std::cout << "REDO SUCCESS: " << reapplied << " parcel changes reapplied and recorded for undo." << std::endl;
+        }
+    }
+
+    // One line of a parcel change: local time, the fields that changed, and why
+    static void print_change(int64_t time_ms, uint8_t fields, ParcelState state, uint32_t weight_g, VersionOrigin origin) {
+        std::time_t seconds = (std::time_t)(time_ms / 1000);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), ".%03d", (int)(time_ms % 1000));
+        std::cout << stamp << millis << "  ";
+        if (fields & kVersionState) {
+            if (state != ParcelState::Free) std::cout << state_name(state);
+            else std::cout << (origin == VersionOrigin::Archive ? "ARCHIVED" : "REMOVED");
+        }
+        if (fields == (kVersionState | kVersionWeight)) std::cout << ", ";
+        if (fields & kVersionWeight) std::cout << "weight " << Weight::from_grams(weight_g) << " kg";
+        std::cout << origin_name(origin) << std::endl;
+    }
+
+    // 21. Parcel History (every recorded version of one parcel, oldest first)
+    void parcel_history_interactive() {
+        int id;
+        std::cout << "\nEnter Parcel ID: ";
+        if (!(std::cin >> id)) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+
+        std::vector<const ParcelVersion*> chain;
+        for_each_history(id, [&](const ParcelVersion& v) { chain.push_back(&v); });
+        if (chain.empty()) {
+            std::cout << "\nNo history recorded for Parcel " << id << "." << std::endl;
+            return;
+        }
+        std::cout << "\n--- History of Parcel " << id << " (" << chain.size() << " versions, oldest first) ---" << std::endl;
+        for (size_t i = chain.size(); i-- > 0;) {
+            const ParcelVersion& v = *chain[i];
+            std::cout << "  ";
+            print_change(v.time_ms, v.fields, v.state, v.weight_g, v.origin);
+        }
+        std::cout << "------------------------------------------" << std::endl;
+    }
+
+    // 22. Point-in-Time Query (state as of a past date and time)
+    void point_in_time_interactive() {
+        std::string date, clock;
+        std::cout << "\nEnter date (YYYY-MM-DD): ";
+        std::cin >> date;
+        std::cout << "Enter time (HH:MM[:SS]): ";
+        std::cin >> clock;
+        std::tm when = std::tm();
+        int seconds = 0;
+        if (std::sscanf(date.c_str(), "%d-%d-%d", &when.tm_year, &when.tm_mon, &when.tm_mday) != 3 ||
+            std::sscanf(clock.c_str(), "%d:%d:%d", &when.tm_hour, &when.tm_min, &seconds) < 2) {
+            std::cout << "\nError: Expected a date like 2024-05-31 and a time like 14:05." << std::endl;
+            return;
+        }
+        when.tm_year -= 1900;
+        when.tm_mon -= 1;
+        when.tm_sec = seconds;
+        when.tm_isdst = -1;
+        std::time_t t = std::mktime(&when);
+        if (t == (std::time_t)-1) {
+            std::cout << "\nError: Invalid date or time." << std::endl;
+            return;
+        }
+        int64_t time_ms = (int64_t)t * 1000 + 999; // the whole second counts
+
+        std::vector<ParcelImage> parcels;
+        int64_t base_ms = 0;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        size_t replayed = parcels_at(time_ms, parcels, base_ms);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        std::cout << "\n--- STATE AS OF " << date << " " << clock << " ---" << std::endl;
+        std::cout << "(" << (base_ms ? "nearest replay snapshot" : "start of history") << " + " << replayed
+                  << " journal records replayed in " << ms << " ms)" << std::endl;
+        size_t counts[kStateCount] = {};
+        int64_t grams[kStateCount] = {};
+        for (const ParcelImage& p : parcels) {
+            ++counts[(int)p.state];
+            grams[(int)p.state] += p.weight_g;
+        }
+        for (int s = (int)ParcelState::Registered; s < kStateCount; ++s) {
+            std::cout << "  " << state_name((ParcelState)s) << ": " << counts[s] << " parcels, "
+                      << Weight::from_grams(grams[s]) << " kg" << std::endl;
+        }
+        if (counts[(int)ParcelState::Free] > 0) {
+            std::cout << "  ARCHIVED: " << counts[(int)ParcelState::Free] << " parcels" << std::endl;
+        }
+        const size_t kListed = 20;
+        size_t listed = 0;
+        for (const ParcelImage& p : parcels) {
+            if (!is_active(p.state)) continue;
+            if (listed++ == kListed) { std::cout << "  ..." << std::endl; break; }
+            std::cout << "  Parcel " << p.id << ": " << state_name(p.state) << ", "
+                      << Weight::from_grams(p.weight_g) << " kg" << std::endl;
+        }
+        std::cout << "------------------------------------------" << std::endl;
+    }
+
+    // 23. Replay Action Log (parallel rebuild from a log file)
+    void replay_action_log_interactive() {
+        std::string path;
+        std::cout << "\nEnter action log file: ";
+        std::cin >> path;
+        ReplayStats stats;
+        if (!replay_action_log(path, stats)) {
+            std::cout << "\nError: Could not open " << path << "." << std::endl;
+            return;
+        }
+        std::cout << "\nSUCCESS: " << stats.records << " log records replayed on " << stats.threads << " threads in "
+                  << stats.replay_ms << " ms; " << stats.parcels << " parcels merged in " << stats.merge_ms << " ms." << std::endl;
+        if (stats.rejected > 0) {
+            std::cout << "WARNING: " << stats.rejected << " records were malformed or invalid for the parcel's state." << std::endl;
+        }
+        if (stats.conflicts > 0) {
+            std::cout << "WARNING: " << stats.conflicts << " parcels skipped: their ids are already in use here or belong to another shard." << std::endl;
+        }
+        if (stats.parcels > 0) std::cout << "The whole replay undoes as one transaction." << std::endl;
+    }
+
+    // 24. Change Stream Tail (CDC records read back from a cursor)
+    void cdc_tail_interactive() {
+        if (!cdc.is_open()) {
+            std::cout << "\nError: The change stream is off (start the program with --cdc=PREFIX)." << std::endl;
+            return;
+        }
+        const uint64_t kShown = 20;
+        uint64_t next = cdc.next();
+        long long from;
+        std::cout << "\nChange stream " << cdc.path_prefix() << " holds sequences 1 to " << next - 1 << "." << std::endl;
+        std::cout << "Enter starting sequence (0 for the last " << kShown << "): ";
+        if (!(std::cin >> from) || from < 0) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+        if (from == 0) from = next > kShown ? (long long)(next - kShown) : 1;
+
+        cdc.wait_written();
+        CdcCursor cursor(cdc.path_prefix(), (uint64_t)from);
+        std::vector<CdcRecord> records;
+        cursor.poll(records, kShown);
+        if (records.empty()) {
+            std::cout << "\nNo changes at or after sequence " << from << "." << std::endl;
+            return;
+        }
+        std::cout << "\n--- CHANGE STREAM from #" << from << " ---" << std::endl;
+        for (const CdcRecord& r : records) {
+            std::cout << "  #" << r.sequence << "  P" << r.id << "  ";
+            print_change(r.time_ms, r.fields, r.state, r.weight_g, r.origin);
+        }
+        std::cout << "(Cursor now at #" << cursor.position() << ")" << std::endl;
+        std::cout << "------------------------------------------" << std::endl;
+    }
+
+    // 25. Event Bus (subscriber status, and attaching the built-in plugins)
+    void event_bus_interactive() {
+        std::cout << "\n--- EVENT BUS: " << events.size() << " subscribers ---" << std::endl;
+        for (size_t i = 0; i < events.size(); ++i) {
+            const EventSubscriber& sub = events.at(i);
+            std::cout << "  " << sub.subscriber_name() << " ("
+                      << (sub.backpressure() == Backpressure::Block ? "block" : "drop") << " when full, queue "
+                      << sub.capacity() << "): " << sub.handled() << " handled, " << sub.queued() << " queued, "
+                      << sub.dropped_count() << " dropped" << std::endl;
+        }
+        if (event_metrics) {
+            std::cout << "Metrics:";
+            for (int t = 0; t < kEventTypeCount; ++t) {
+                std::cout << (t ? ", " : " ") << event_name((EventType)t) << " "
+                          << event_metrics->counts[t].load(std::memory_order_relaxed);
+            }
+            std::cout << std::endl;
+        }
+
+        int plugin;
+        std::cout << "\nAttach plugin (1 = metrics, 2 = customer notifications file, 0 = none): ";
+        if (!(std::cin >> plugin) || plugin < 0 || plugin > 2) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+        if (plugin == 0) return;
+        if (plugin == 1 && event_metrics) {
+            std::cout << "\nError: The metrics plugin is already attached." << std::endl;
+            return;
+        }
+        std::string path;
+        if (plugin == 2) {
+            std::cout << "Enter notifications file: ";
+            std::cin >> path;
+        }
+        size_t capacity;
+        char policy;
+        std::cout << "Queue capacity (events): ";
+        if (!(std::cin >> capacity) || capacity == 0) { clear_input(); std::cout << "Invalid input." << std::endl; return; }
+        std::cout << "When the queue is full, (d)rop events or (b)lock operations? ";
+        std::cin >> policy;
+        Backpressure backpressure = (policy == 'b' || policy == 'B') ? Backpressure::Block : Backpressure::Drop;
+
+        if (plugin == 1) {
+            std::shared_ptr<EventMetrics> metrics(new EventMetrics());
+            subscribe("metrics", kAllEvents, backpressure, capacity, [metrics](const ParcelEvent& e) {
+                metrics->counts[(int)e.type].fetch_add(1, std::memory_order_relaxed);
+            });
+            event_metrics = metrics;
+        } else {
+            std::shared_ptr<std::ofstream> out(new std::ofstream(path.c_str(), std::ios::app));
+            if (!*out) {
+                std::cout << "\nError: Could not open " << path << "." << std::endl;
+                return;
+            }
+            uint16_t types = event_bit(EventType::Dispatched) | event_bit(EventType::Delivered) | event_bit(EventType::Cancelled);
+            subscribe("notifications", types, backpressure, capacity, [out](const ParcelEvent& e) {
+                *out << "Parcel " << e.id << " has been " << event_name(e.type)
+                     << (e.origin == VersionOrigin::Undo ? " (correction)" : "") << "." << std::endl;
+            });
+        }
+        std::cout << "\nSUCCESS: Plugin attached; it receives every matching event from now on." << std::endl;
+    }
+
+    // 26. Replication (role, replicas or lag, and promoting a replica)
+    void replication_interactive() {
+        if (!read_only) {
+            if (!replication.is_open()) {
+                std::cout << "\nReplication is off (start with --replicate=SOCKET to serve replicas, "
+                          << "or --replica-of=SOCKET to run as one)." << std::endl;
+                return;
+            }
+            std::cout << "\nPRIMARY: serving " << replication.replica_count() << " replicas on " << replication.socket_path()
+                      << "; " << replication.published() << " changes published." << std::endl;
+            return;
+        }
+        int64_t now = wall_clock_ms();
+        uint64_t applied = replica.applied_sequence();
+        uint64_t primary = replica.primary_sequence();
+        std::cout << "\nREPLICA of " << replica.socket_path() << " ("
+                  << (replica.is_connected() ? "connected" : "disconnected") << ")" << std::endl;
+        std::cout << "Applied change #" << applied << " of #" << primary << ": lag " << primary - applied << " changes";
+        if (primary > applied && replica.applied_change_ms() > 0) std::cout << ", " << now - replica.applied_change_ms() << " ms";
+        std::cout << "." << std::endl;
+        if (replica.last_heartbeat_ms() > 0) {
+            std::cout << "Last heartbeat from the primary: " << now - replica.last_heartbeat_ms() << " ms ago." << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> guard(replica_lock);
+            if (!replica_error.empty()) std::cout << "Error: Replication stopped: " << replica_error << "." << std::endl;
+        }
+        char answer;
+        std::cout << "Promote this replica to primary? (y/n): ";
+        std::cin >> answer;
+        if (answer != 'y' && answer != 'Y') return;
+        promote();
+        std::cout << "\nSUCCESS: Promoted to primary at change #" << applied << "; this manager now accepts changes." << std::endl;
+        if (replication.is_open()) std::cout << "Serving replicas on " << replication.socket_path() << "." << std::endl;
+    }
+
+    // 27. Display Menu
+    void display_menu() const {
+        std::cout << "\n=======================================" << std::endl;
+        std::cout << "JUMIA LOGISTICS MANAGEMENT SYSTEM" << std::endl;
+        if (read_only) std::cout << "(READ-ONLY REPLICA: promote with 26)" << std::endl;
+        std::cout << "=======================================" << std::endl;
+        std::cout << "1. Register New Parcel (Slot Store Insert)" << std::endl;
+        std::cout << "2. Update Parcel Weight (Hot Record Search/Update)" << std::endl;
+        std::cout << "3. Prepare for Loading (Priority Queue Enqueue)" << std::endl;
+        std::cout << "4. Dispatch Next Parcel (Priority Queue Dequeue)" << std::endl;
+        std::cout << "5. Complete Delivery (Slot Store Delete & Array Audit)" << std::endl;
+        std::cout << "6. Undo Last Action (Stack Pop/LIFO)" << std::endl;
+        std::cout << "7. Generate Summary Reports" << std::endl;
+        std::cout << "8. Search Parcel by ID (Existence Filter)" << std::endl;
+        std::cout << "9. Archive Delivered Parcels" << std::endl;
+        std::cout << "10. Checkpoint (Clear Undo History)" << std::endl;
+        std::cout << "11. Allocation Audit" << std::endl;
+        std::cout << "12. Cancel Parcel" << std::endl;
+        std::cout << "13. Dispatch Batch (Top N / Weight Budget)" << std::endl;
+        std::cout << "14. Bulk Load (Id List / Priority Filter)" << std::endl;
+        std::cout << "15. Bulk Delivery (Manifest File)" << std::endl;
+        std::cout << "16. Bulk Weight Corrections (File)" << std::endl;
+        std::cout << "17. Begin Transaction" << std::endl;
+        std::cout << "18. Commit Transaction";
+        if (in_transaction()) std::cout << " (open: " << transaction_size() << " entries)";
+        std::cout << std::endl;
+        std::cout << "19. Selective Undo (Parcel History)" << std::endl;
+        std::cout << "20. Redo Last Undone Action" << std::endl;
+        std::cout << "21. Parcel History (Version Chain)" << std::endl;
+        std::cout << "22. Point-in-Time Query (Replay Snapshots)" << std::endl;
+        std::cout << "23. Replay Action Log (Parallel)" << std::endl;
+        std::cout << "24. Change Stream Tail (CDC)" << std::endl;
+        std::cout << "25. Event Bus (Plugins)" << std::endl;
+        std::cout << "26. Replication (Status / Promote)" << std::endl;
+        std::cout << "0. Exit Program" << std::endl;
+        std::cout << "Enter choice: ";
+    }
+};
+
+// Benchmark suite: drives the core operations over 'parcels' parcels for two
+// rounds on one manager (auto ids) and reports round two, after warm-up.
+// Allocations per operation are real counts when built with JUMIA_ALLOC_AUDIT.
+void run_benchmark(ManagerConfig config, size_t parcels) {
+    config.auto_ids = true;
+    config.archive_prefix = "jumia_bench_archive"; // nothing is sealed; avoids loading real segments
+    config.persist_history = false;
+    if (config.reserve_parcels < 2 * parcels) config.reserve_parcels = 2 * parcels;
+    JumiaLogisticsManager manager(config);
+
+    std::vector<int> ids(parcels);
+    double ns_per_op[kOpCount] = {};
+    for (int round = 1; round <= 2; ++round) {
+        manager.reset_undo_history();
+        manager.reset_allocation_stats();
+        std::chrono::steady_clock::time_point t0, t1;
+        Parcel p;
+        p.sender.assign("bench-sender");
+        p.recipient.assign("bench-recipient");
+        p.address.assign("bench-address");
+
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < parcels; ++i) {
+            p.weight = Weight::from_grams(500 + (int64_t)(i % 20000));
+            p.priority = 1 + (int)(i % 5);
+            manager.register_parcel(p);
+            ids[i] = p.id;
+        }
+        t1 = std::chrono::steady_clock::now();
+        ns_per_op[kOpRegister] = std::chrono::duration<double, std::nano>(t1 - t0).count() / parcels;
+
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < parcels; ++i) manager.update_weight(ids[i], Weight::from_grams(1000 + (int64_t)i % 7));
+        t1 = std::chrono::steady_clock::now();
+        ns_per_op[kOpUpdate] = std::chrono::duration<double, std::nano>(t1 - t0).count() / parcels;
+
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < parcels; ++i) manager.load_parcel(ids[i]);
+        t1 = std::chrono::steady_clock::now();
+        ns_per_op[kOpLoad] = std::chrono::duration<double, std::nano>(t1 - t0).count() / parcels;
+
+        t0 = std::chrono::steady_clock::now();
+        uint32_t dispatched;
+        for (size_t i = 0; i < parcels; ++i) manager.dispatch_next(dispatched);
+        t1 = std::chrono::steady_clock::now();
+        ns_per_op[kOpDispatch] = std::chrono::duration<double, std::nano>(t1 - t0).count() / parcels;
+
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < parcels; ++i) manager.deliver_parcel(ids[i]);
+        t1 = std::chrono::steady_clock::now();
+        ns_per_op[kOpDeliver] = std::chrono::duration<double, std::nano>(t1 - t0).count() / parcels;
+    }
+
+    std::cout << "Benchmark: " << parcels << " parcels, round 2 of 2 ("
+              << (config.zero_alloc ? "zero-allocation mode" : "heap mode") << ")" << std::endl;
+#ifndef JUMIA_ALLOC_AUDIT
+    std::cout << "(Built without JUMIA_ALLOC_AUDIT: allocation counts are not tracked.)" << std::endl;
+#endif
+    for (int op = kOpRegister; op <= kOpDeliver; ++op) {
+        const OpAllocStats& s = manager.allocation_stats((OpKind)op);
+        double allocs_per_op = s.calls ? (double)s.allocations / s.calls : 0.0;
+        std::cout << "  " << kOpNames[op] << ": " << ns_per_op[op] << " ns/op, "
+                  << allocs_per_op << " allocs/op" << std::endl;
+    }
+    if (config.huge_pages != HugePages::Off) {
+        HugePageStats pages = manager.huge_page_stats();
+        std::cout << "Huge pages (" << huge_pages_name(config.huge_pages) << "): " << pages.huge_pages
+                  << " of " << pages.pages << " 2 MiB pages backed by huge pages" << std::endl;
+    }
+}
+
+// Self-check: runs the core data structures against known answers.
+// Returns the process exit code (0 when every check passes).
+int run_self_check(ManagerConfig config) {
+    int failures = 0;
+    auto check = [&](const char* what, bool ok) {
+        std::cout << "  " << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+        if (!ok) ++failures;
+    };
+    std::cout << "Self-check:" << std::endl;
+    config.persist_history = false; // only the history restart check keeps a journal file
+
+    // Action log parsing: a field never comes from the next line, and extra tokens reject the line
+    {
+        const std::string log =
+            "REGISTER 12 Ada Bola Lagos 1.5 2\n"
+            "LOAD\n"
+            "12 junk\n"
+            "UPDATE 12\n"
+            "2.5\n"
+            "REGISTER 13 Ada Bola Lagos 1.0 2 extra\n"
+            "REGISTER 14 Ada Bola Lagos 1.0\n"
+            "\n"
+            "UPDATE 12 2.25\r\n"
+            "LOAD 12";
+        for (unsigned threads = 1; threads <= 3; threads += 2) {
+            ActionLogReplay replay(log, threads);
+            replay.run();
+            const ReplayImage* image = nullptr;
+            size_t images = 0;
+            for (const auto& partition : replay.results()) {
+                for (const ReplayImage& i : partition) {
+                    ++images;
+                    if (i.id == 12) image = &i;
+                }
+            }
+            check(threads == 1 ? "replay: only well-formed lines are records (1 thread)"
+                               : "replay: only well-formed lines are records (3 threads)",
+                  replay.record_count() == 3 && replay.rejected() == 6);
+            check(threads == 1 ? "replay: parcel 12 folds to LOADED, 2.25 kg (1 thread)"
+                               : "replay: parcel 12 folds to LOADED, 2.25 kg (3 threads)",
+                  images == 1 && image && image->state == ParcelState::Loaded && image->weight_g == 2250 && image->priority == 2);
+        }
+    }
+
+    // Grouped undo and redo while the parcels sit in the loading queue
+    {
+        config.auto_ids = true;
+        config.archive_prefix = "jumia_self_check_archive"; // nothing is sealed
+        JumiaLogisticsManager manager(config);
+        std::ostringstream quiet; // the undo menu action reports on std::cout
+        std::streambuf* console = std::cout.rdbuf();
+        const size_t kParcels = 600; // spans several undo stack blocks
+        std::vector<int> ids(kParcels);
+        Parcel p;
+        p.sender.assign("check-sender");
+        p.recipient.assign("check-recipient");
+        p.address.assign("check-address");
+
+        manager.begin_transaction();
+        for (size_t i = 0; i < kParcels; ++i) {
+            p.weight = Weight::from_grams(1000 + (int64_t)i);
+            p.priority = 1 + (int)(i % 5);
+            manager.register_parcel(p);
+            ids[i] = p.id;
+        }
+        manager.commit_transaction();
+        size_t loaded = 0;
+        for (int id : ids) loaded += manager.load_parcel(id) ? 1 : 0;
+        std::cout.rdbuf(quiet.rdbuf());
+        manager.undo_last_action();
+        std::cout.rdbuf(console);
+        uint32_t dispatched;
+        check("undo: a transaction of loaded registrations empties the store and the queue",
+              loaded == kParcels && manager.parcels_in(ParcelState::Registered) == 0 &&
+              manager.parcels_in(ParcelState::Loaded) == 0 && !manager.dispatch_next(dispatched));
+        uint32_t reapplied = 0;
+        check("redo: the transaction registers every parcel again",
+              manager.redo_last(reapplied) && reapplied == kParcels && manager.parcels_in(ParcelState::Registered) == kParcels);
+
+        for (int id : ids) manager.load_parcel(id);
+        DispatchManifest manifest;
+        size_t batch = manager.dispatch_batch(kParcels / 3, Weight(), manifest);
+        std::cout.rdbuf(quiet.rdbuf());
+        manager.undo_last_action();
+        std::cout.rdbuf(console);
+        check("undo: a batch dispatch puts every parcel back on the queue",
+              batch == kParcels / 3 && manager.parcels_in(ParcelState::Dispatched) == 0 &&
+              manager.parcels_in(ParcelState::Loaded) == kParcels);
+        check("redo: the batch dispatch is applied again",
+              manager.redo_last(reapplied) && reapplied == batch &&
+              manager.parcels_in(ParcelState::Dispatched) == batch);
+        size_t drained = 0;
+        while (manager.dispatch_next(dispatched)) ++drained;
+        check("queue: holds exactly the parcels still loaded", drained == kParcels - batch);
+    }
+
+    // Loading queue: parcels taken out from the middle leave a heap that still pops in priority order
+    {
+        const uint32_t kSlots = 1000;
+        LoadingQueue queue;
+        std::vector<uint32_t> priority(kSlots);
+        for (uint32_t slot = 0; slot < kSlots; ++slot) {
+            priority[slot] = 1 + (slot * 7919) % 5;
+            queue.push(slot, (int)priority[slot]);
+        }
+        bool taken_ok = !queue.push(1, 1); // already queued: no second handle
+        for (uint32_t slot = 0; slot < kSlots; slot += 3) taken_ok = taken_ok && queue.take(slot);
+        taken_ok = taken_ok && !queue.take(0) && !queue.take(kSlots + 5);
+        bool ordered = true;
+        size_t popped = 0;
+        uint32_t last = 0;
+        while (!queue.empty()) {
+            uint32_t slot = queue.pop().release();
+            ordered = ordered && slot % 3 != 0 && priority[slot] >= last;
+            last = priority[slot];
+            ++popped;
+        }
+        check("queue: one handle per slot, and take removes exactly the parcel asked for", taken_ok);
+        check("queue: the rest still pops in priority order", ordered && popped == kSlots - (kSlots + 2) / 3);
+    }
+
+    // Restart over an archive bigger than the existence filters start out: every archived id stays known
+    {
+        ManagerConfig restart = config;
+        restart.auto_ids = false;
+        restart.archive_prefix = "jumia_self_check_restart";
+        const int kArchived = 5000;
+        for (int n = 1; n <= 2; ++n) {
+            char suffix[24];
+            std::snprintf(suffix, sizeof(suffix), "_%04d.dat", n);
+            std::remove((restart.archive_prefix + suffix).c_str());
+        }
+        std::ostringstream quiet;
+        std::streambuf* console = std::cout.rdbuf();
+        Parcel p;
+        p.sender.assign("check-sender");
+        p.recipient.assign("check-recipient");
+        p.address.assign("check-address");
+        p.weight = Weight::from_grams(1000);
+        p.priority = 3;
+        {
+            JumiaLogisticsManager first_run(restart);
+            for (int id = 1; id <= kArchived; ++id) {
+                p.id = id;
+                first_run.register_parcel(p);
+                first_run.deliver_parcel(id);
+            }
+            std::cout.rdbuf(quiet.rdbuf());
+            first_run.archive_delivered_parcels();
+            std::cout.rdbuf(console);
+        }
+        JumiaLogisticsManager second_run(restart);
+        int reused = 0;
+        for (int id = 1; id <= kArchived; ++id) {
+            p.id = id;
+            if (second_run.register_parcel(p)) ++reused;
+        }
+        check("restart: every archived id is still known to the existence filters", reused == 0);
+        std::remove((restart.archive_prefix + "_0001.dat").c_str());
+    }
+
+    // History across a restart: the journal file brings back the chain, and the parcel the last run held is closed as lost
+    {
+        ManagerConfig restart = config;
+        restart.auto_ids = false;
+        restart.persist_history = true;
+        restart.archive_prefix = "jumia_self_check_history";
+        std::string journal = cdc_segment_path(restart.archive_prefix + "_history", 1);
+        std::remove(journal.c_str());
+        Parcel p;
+        p.id = 42;
+        p.sender.assign("check-sender");
+        p.recipient.assign("check-recipient");
+        p.address.assign("check-address");
+        p.weight = Weight::from_grams(1000);
+        p.priority = 3;
+        int64_t before_restart = 0;
+        {
+            JumiaLogisticsManager first_run(restart);
+            first_run.register_parcel(p);
+            first_run.update_weight(p.id, Weight::from_grams(2500));
+            before_restart = wall_clock_ms();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        JumiaLogisticsManager second_run(restart);
+        std::vector<VersionOrigin> origins;
+        second_run.for_each_history(p.id, [&](const ParcelVersion& v) { origins.push_back(v.origin); });
+        check("history restart: the earlier run's versions are read back, closed by a restart removal",
+              origins.size() == 3 && origins[0] == VersionOrigin::Restart && origins[2] == VersionOrigin::Operation);
+        std::vector<ParcelImage> then, now;
+        int64_t base_ms = 0;
+        second_run.parcels_at(before_restart, then, base_ms);
+        second_run.parcels_at(wall_clock_ms(), now, base_ms);
+        check("history restart: a point-in-time query before the restart sees the parcel at its updated weight",
+              then.size() == 1 && then[0].id == p.id && then[0].weight_g == 2500 && now.empty());
+        std::remove(journal.c_str());
+    }
+
+    // Eytzinger lookup: every key found at its offset, every gap missed, across tree sizes
+    {
+        bool all_found = true, none_false = true;
+        for (size_t n : {0, 1, 2, 15, 16, 17, 255, 1000, 4097}) {
+            std::vector<std::pair<int, uint32_t> > entries;
+            for (size_t i = 0; i < n; ++i) entries.push_back(std::make_pair((int)(3 * i + 1), (uint32_t)(100 + i)));
+            std::reverse(entries.begin(), entries.end());
+            EytzingerIndex index;
+            index.build(entries);
+            uint32_t offset = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (!index.find((int)(3 * i + 1), offset) || offset != 100 + i) all_found = false;
+            }
+            for (size_t i = 0; i <= n; ++i) {
+                if (index.find((int)(3 * i), offset) || index.find((int)(3 * i + 2), offset)) none_false = false;
+            }
+        }
+        check("archive index: finds every key with its offset", all_found);
+        check("archive index: reports no false matches", none_false);
+    }
+
+    std::cout << (failures == 0 ? "All checks passed." : "Some checks FAILED.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// Dashboard side of --shm: maps a running manager's shared view read-only,
+// takes one consistent copy and prints it. Returns the process exit code.
+int print_shared_view(const std::string& name) {
+    SharedView view;
+    if (!view.open(name)) {
+        std::cout << "Error: No shared view named " << name << " (is a manager running with --shm=" << name << "?)" << std::endl;
+        return 1;
+    }
+    SharedViewSnapshot snapshot;
+    if (!view.read(snapshot, 1000)) {
+        std::cout << "Error: The view kept changing; no consistent copy after 1000 attempts." << std::endl;
+        return 1;
+    }
+    std::time_t seconds = (std::time_t)(snapshot.updated_ms / 1000);
+    char stamp[32] = "-";
+    if (snapshot.changes > 0) std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+    std::cout << "--- SHARED VIEW " << name << ": " << snapshot.changes << " changes, last at " << stamp << " ---" << std::endl;
+    for (int s = (int)ParcelState::Registered; s < kStateCount; ++s) {
+        std::cout << "  " << state_name((ParcelState)s) << ": " << snapshot.counts[s] << " parcels, "
+                  << Weight::from_grams((int64_t)snapshot.weights_g[s]) << " kg" << std::endl;
+    }
+    std::cout << "  ARCHIVED: " << snapshot.counts[(int)ParcelState::Free] << " parcels, "
+              << Weight::from_grams((int64_t)snapshot.weights_g[(int)ParcelState::Free]) << " kg" << std::endl;
+    const size_t kListed = 20;
+    size_t listed = 0;
+    for (uint32_t slot = 0; slot < snapshot.rows; ++slot) {
+        ParcelState state = (ParcelState)snapshot.states[slot];
+        if (state == ParcelState::Free) continue;
+        if (listed++ == kListed) { std::cout << "  ..." << std::endl; break; }
+        std::cout << "  Parcel " << snapshot.ids[slot] << ": " << state_name(state) << ", "
+                  << Weight::from_grams(snapshot.weights[slot]) << " kg (P" << (int)snapshot.priorities[slot] << ")" << std::endl;
+    }
+    if (snapshot.overflow > 0) std::cout << "  (" << snapshot.overflow << " parcels beyond the view's rows are counted but not listed)" << std::endl;
+    std::cout << "------------------------------------------" << std::endl;
+    return 0;
+}
+
+// Usage: program [--auto-ids] [--shard=N] [--archive=PREFIX] [--zero-alloc] [--reserve=N]
+//                [--huge-pages[=transparent|explicit]] [--replay-threads=N] [--cdc=PREFIX]
+//                [--replicate=SOCKET | --replica-of=SOCKET] [--shm=NAME] [--bench=N]
+//        program --view=NAME   (print the shared view of a manager running with --shm=NAME)
+//        program --self-check  (run the built-in checks; exit code 1 on failure)
+int main(int argc, char* argv[]) {
+    ManagerConfig config;
+    size_t bench_parcels = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--auto-ids") == 0) {
+            config.auto_ids = true;
+        } else if (std::strncmp(argv[i], "--shard=", 8) == 0) {
+            config.shard = std::atoi(argv[i] + 8);
+            if (config.shard < 0 || config.shard > kMaxShard) {
+                std::cout << "Shard must be between 0 and " << kMaxShard << "." << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(argv[i], "--archive=", 10) == 0) {
+            config.archive_prefix = argv[i] + 10;
+        } else if (std::strcmp(argv[i], "--zero-alloc") == 0) {
+            config.zero_alloc = true;
+        } else if (std::strncmp(argv[i], "--reserve=", 10) == 0) {
+            config.reserve_parcels = (size_t)std::atol(argv[i] + 10);
+        } else if (std::strcmp(argv[i], "--huge-pages") == 0 || std::strcmp(argv[i], "--huge-pages=transparent") == 0) {
+            config.huge_pages = HugePages::Transparent;
+        } else if (std::strcmp(argv[i], "--huge-pages=explicit") == 0) {
+            config.huge_pages = HugePages::Explicit;
+        } else if (std::strncmp(argv[i], "--replay-threads=", 17) == 0) {
+            config.replay_threads = (unsigned)std::atoi(argv[i] + 17);
+        } else if (std::strncmp(argv[i], "--cdc=", 6) == 0) {
+            config.cdc_prefix = argv[i] + 6;
+        } else if (std::strncmp(argv[i], "--replicate=", 12) == 0) {
+            config.replicate_path = argv[i] + 12;
+        } else if (std::strncmp(argv[i], "--replica-of=", 13) == 0) {
+            config.replica_of = argv[i] + 13;
+        } else if (std::strncmp(argv[i], "--shm=", 6) == 0) {
+            config.shm_name = argv[i] + 6;
+        } else if (std::strncmp(argv[i], "--view=", 7) == 0) {
+            return print_shared_view(argv[i] + 7);
+        } else if (std::strncmp(argv[i], "--bench=", 8) == 0) {
+            bench_parcels = (size_t)std::atol(argv[i] + 8);
+        } else if (std::strcmp(argv[i], "--self-check") == 0) {
+            return run_self_check(config);
+        } else {
+            std::cout << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (bench_parcels > 0) {
+        run_benchmark(config, bench_parcels);
+        return 0;
+    }
+    JumiaLogisticsManager manager(config);
+    int choice;
+
+    do {
+        manager.display_menu();
+        if (!(std::cin >> choice)) {
+            // Error handling calls the now PUBLIC clear_input()
+            manager.clear_input(); 
+            choice = -1; 
+            std::cout << "Invalid input type. Please enter a number." << std::endl;
+        }
+
+        // Promotion stops the replica link, so it runs before the lock is taken
+        if (choice == 26) manager.replication_interactive();
+        std::unique_lock<std::mutex> replica_guard = manager.lock_replica();
+        if (manager.is_replica() && choice != -1 && !JumiaLogisticsManager::read_only_choice(choice)) {
+            std::cout << "Error: This manager is a read-only replica; promote it first (menu 26)." << std::endl;
+            continue;
+        }
+
+        switch (choice) {
+            case 1: manager.register_parcel_interactive(); break;
+            case 2: manager.update_parcel_interactive(); break;
+            case 3: manager.prepare_for_loading_interactive(); break;
+            case 4: manager.dispatch_next_parcel(); break;
+            case 5: manager.complete_delivery_interactive(); break;
+            case 6: manager.undo_last_action(); break;
+            case 7: manager.generate_summary_reports(); break;
+            case 8: manager.search_parcel_interactive(); break;
+            case 9: manager.archive_delivered_parcels(); break;
+            case 10: manager.checkpoint_history(); break;
+            case 11: manager.print_allocation_report(); break;
+            case 12: manager.cancel_parcel_interactive(); break;
+            case 13: manager.dispatch_batch_interactive(); break;
+            case 14: manager.bulk_load_interactive(); break;
+            case 15: manager.bulk_delivery_interactive(); break;
+            case 16: manager.bulk_weight_update_interactive(); break;
+            case 17: manager.begin_transaction_interactive(); break;
+            case 18: manager.commit_transaction_interactive(); break;
+            case 19: manager.selective_undo_interactive(); break;
+            case 20: manager.redo_last_action(); break;
+            case 21: manager.parcel_history_interactive(); break;
+            case 22: manager.point_in_time_interactive(); break;
+            case 23: manager.replay_action_log_interactive(); break;
+            case 24: manager.cdc_tail_interactive(); break;
+            case 25: manager.event_bus_interactive(); break;
+            case 26: break; // handled above
+            case 0: std::cout << "Exiting Jumia Logistics System. Goodbye!" << std::endl; break;
+            default: 
+                if (choice != -1) { // Avoid printing error twice if input failed
+                    std::cout << "Invalid choice. Please try again (0-26)." << std::endl; 
+                }
+                break;
+        }
+        manager.take_replay_snapshots(); // between commands, never inside an operation
+    } while (choice != 0);
+
+    return 0;
+}